@@ -1,14 +1,24 @@
-// @todo: bundle: flush zip stream while compressing (flushing a single memory block when compressing large folders is a crazy idea)
-// @todo: bundler: parallel unpack (good idea?)
-// @todo: bundler: if lzma_big_dicts * num threads > current_mem force threads=1; || warn "allocation error" 
-
 #ifdef _WIN32
 #define NOMINMAX
 #include <winsock2.h>
 #include <direct.h>
+#include <sys/stat.h>
+#include <io.h>
+#include <fcntl.h>
 #define mkdir(str,mode) _mkdir(str)
+#ifndef S_ISDIR
+#define S_ISDIR(mode) ( ( (mode) & S_IFMT ) == S_IFDIR )
+#endif
+#ifndef S_ISREG
+#define S_ISREG(mode) ( ( (mode) & S_IFMT ) == S_IFREG )
+#endif
 #else
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 #include <wire/wire.hpp>
@@ -16,17 +26,66 @@
 #include <bubble/bubble.hpp>
 #include <bundle/bundle.hpp>
 
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#include <nmmintrin.h>
+#define BUNDLER_CRC32C_SSE42 1
+#endif
+
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <future>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
 #include <string>
 #include <thread>
+#include <tuple>
+#include <vector>
 #include <stdint.h>
 
-#define BUNDLER_VERSION "2.1.3" /* (2016/02/08) add BZIP2 support
+#define BUNDLER_VERSION "2.3.8" /* (2026/10/16) add -P/--progress: console thread, status lines as text or json
+#define BUNDLER_VERSION "2.3.7" // (2026/10/16) add -l/--deadline and -R/--throughput: pick encoders from their measured speed
+#define BUNDLER_VERSION "2.3.6" // (2026/10/16) x86/arm/arm64, delta and transpose filters ahead of encoders; add -F/--no-filters
+#define BUNDLER_VERSION "2.3.5" // (2026/10/16) entropy probe: store incompressible inputs raw without trying encoders
+#define BUNDLER_VERSION "2.3.4" // (2026/10/16) CRC-32C checksums of payloads and contents; verify command (v)
+#define BUNDLER_VERSION "2.3.3" // (2026/10/16) add -D/--dictionary: shared dictionary for small files
+#define BUNDLER_VERSION "2.3.2" // (2026/10/16) preallocated, unbuffered extract writes; directory cache
+#define BUNDLER_VERSION "2.3.1" // (2026/10/16) per-worker reusable buffers
+#define BUNDLER_VERSION "2.3.0" // (2026/10/16) parallel directory walk, overlapped with packing
+#define BUNDLER_VERSION "2.2.9" // (2026/10/16) pack from stdin (-), extract to stdout (-o)
+#define BUNDLER_VERSION "2.2.8" // (2026/10/16) per-stage timings (-v) and traces (-T)
+#define BUNDLER_VERSION "2.2.7" // (2026/10/16) bench command (b)
+#define BUNDLER_VERSION "2.2.6" // (2026/10/16) memory-budgeted scheduler (-m)
+#define BUNDLER_VERSION "2.2.5" // (2026/10/16) add -k/--chunk: pack and unpack large files in parallel chunks
+#define BUNDLER_VERSION "2.2.4" // (2026/10/16) add -s/--solid: pack small files together in solid blocks
+#define BUNDLER_VERSION "2.2.3" // (2026/10/16) deduplicate identical files
+#define BUNDLER_VERSION "2.2.2" // (2026/10/16) add update command: reuse payloads of unchanged files; add -H/--hash
+#define BUNDLER_VERSION "2.2.1" // (2026/10/16) add -c/--cache: learn encoder choices per file extension across runs
+#define BUNDLER_VERSION "2.2.0" // (2026/10/16) add -p/--predict: shortlist encoders from sampled blocks
+#define BUNDLER_VERSION "2.1.9" // (2026/10/16) read input files once into preallocated buffers; read-ahead hints
+#define BUNDLER_VERSION "2.1.8" // (2026/10/16) extract, test and list files that match given masks; add -e/--exclude
+#define BUNDLER_VERSION "2.1.7" // (2026/10/16) memory-mapped archive reader; lazy payload fetching
+#define BUNDLER_VERSION "2.1.6" // (2026/10/16) stream packed payloads to disk; write index at end
+#define BUNDLER_VERSION "2.1.5" // (2026/10/16) parallel extract and test; ordered writer
+#define BUNDLER_VERSION "2.1.4" // (2026/10/16) replace per-file threads with a work-stealing pool; report worker usage in verbose mode
+#define BUNDLER_VERSION "2.1.3" // (2016/02/08) add BZIP2 support
 #define BUNDLER_VERSION "2.1.2" // (2015/12/04) update BUNDLE library
 #define BUNDLER_VERSION "2.1.1" // (2015/12/02) add CRUSH/LZJB support
 #define BUNDLER_VERSION "2.1.0" // (2015/11/24) add ZMOLLY/ZLING/ZSTDF/TANGELO/BCM/MCM support
@@ -79,6 +138,236 @@ auto taken = []() -> double {
     return std::chrono::duration_cast< std::chrono::milliseconds >( now() - then ).count() / 1000.0;
 };
 
+// time spent in every stage. each thread accumulates into a slot of its own, so probes never contend on a lock;
+// slots are only added up when reporting. when tracing, every probe is kept as an event for a chrome://tracing file.
+struct profiler {
+    enum { SCAN, READ, TRAIN, PROBE, FILTER, PREDICT, PACK, QUEUE, WRITE, INDEX, CHECK, DECODE, WAIT, STAGES };
+
+    struct event {
+        unsigned stage;
+        double start, secs;
+        std::uint64_t bytes;
+    };
+
+    struct slot {
+        double secs[STAGES] = {};
+        std::uint64_t bytes[STAGES] = {}, calls[STAGES] = {};
+        std::vector<event> events;
+    };
+
+    bool tracing = false;
+
+    static const char *name_of( unsigned stage ) {
+        static const char *names[STAGES] = { "scan", "read", "train", "probe", "filter", "predict", "pack", "queue", "write", "index", "check", "decode", "wait" };
+        return stage < STAGES ? names[stage] : "";
+    }
+
+    void add( unsigned stage, std::chrono::steady_clock::time_point start, std::uint64_t bytes = 0 ) {
+        auto end = now();
+        auto &in = local();
+        double secs = std::chrono::duration_cast< std::chrono::microseconds >( end - start ).count() / 1000000.0;
+        in.secs[stage] += secs;
+        in.bytes[stage] += bytes;
+        in.calls[stage] ++;
+        if( tracing ) {
+            double at = std::chrono::duration_cast< std::chrono::microseconds >( start - then ).count() / 1000000.0;
+            in.events.push_back( event { stage, at, secs, bytes } );
+        }
+    }
+
+    // secs are thread-seconds: stages that run in parallel can add up to more than the elapsed time
+    std::string report() const {
+        std::lock_guard<std::mutex> lock( mutex );
+        std::stringstream cout;
+        for( unsigned stage = 0; stage < STAGES; ++stage ) {
+            double secs = 0;
+            std::uint64_t bytes = 0, calls = 0;
+            for( auto &in : slots ) {
+                secs += in->secs[stage], bytes += in->bytes[stage], calls += in->calls[stage];
+            }
+            if( !calls ) {
+                continue;
+            }
+            cout << "stage " << name_of( stage ) << ": " << calls << " calls, " << secs << " secs";
+            if( bytes ) {
+                cout << ", " << bytes << " bytes (" << ( secs > 0 ? bytes / secs / 1000000.0 : 0 ) << " MB/s)";
+            }
+            cout << std::endl;
+        }
+        return cout.str();
+    }
+
+    bool trace( const std::string &pathfile ) const {
+        std::lock_guard<std::mutex> lock( mutex );
+        std::ofstream ofs( pathfile.c_str(), std::ios::binary | std::ios::trunc );
+        ofs << "{\"traceEvents\":[\n";
+        const char *sep = "";
+        for( size_t tid = 0; tid < slots.size(); ++tid ) {
+            for( auto &ev : slots[tid]->events ) {
+                ofs << sep << "{\"name\":\"" << name_of( ev.stage ) << "\",\"cat\":\"bundler\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+                    << ",\"ts\":" << std::uint64_t( ev.start * 1000000 ) << ",\"dur\":" << std::uint64_t( ev.secs * 1000000 )
+                    << ",\"args\":{\"bytes\":" << ev.bytes << "}}";
+                sep = ",\n";
+            }
+        }
+        ofs << "\n]}\n";
+        ofs.close();
+        return !ofs.fail();
+    }
+
+private:
+
+    slot &local() {
+        thread_local slot *mine = 0;
+        if( !mine ) {
+            std::lock_guard<std::mutex> lock( mutex );
+            slots.emplace_back( new slot );
+            mine = slots.back().get();
+        }
+        return *mine;
+    }
+
+    mutable std::mutex mutex;
+    std::vector< std::unique_ptr<slot> > slots;
+};
+
+profiler stages;
+
+// console output goes through a thread of its own, so workers never wait on console i/o: they only queue lines.
+// the same thread prints a status line, at most once per `interval` seconds, when a status function is given.
+struct console {
+    // a line being composed with <<. it is queued whole once the statement that composes it ends.
+    struct line {
+        console *to;
+        std::ostream *os;
+        std::string text;
+
+        line( console *to, std::ostream *os ) : to( to ), os( os )
+        {}
+
+        line( line &&other ) : to( other.to ), os( other.os ), text( std::move( other.text ) ) {
+            other.to = 0;
+        }
+
+        ~line() {
+            if( to ) {
+                to->print( *os, text );
+            }
+        }
+
+        template<typename T>
+        line &operator<<( const T &value ) {
+            std::ostringstream ss;
+            ss << value;
+            text += ss.str();
+            return *this;
+        }
+
+        line &operator<<( std::ostream &( *manip )( std::ostream & ) ) {
+            std::ostringstream ss;
+            ss << manip;
+            text += ss.str();
+            return *this;
+        }
+    };
+
+    std::function<std::string()> status;
+    double interval = 1;
+
+    line out() {
+        return line( this, &std::cout );
+    }
+
+    line err() {
+        return line( this, &std::cerr );
+    }
+
+    void print( std::ostream &os, const std::string &text ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        lines.push_back( std::make_pair( &os, text ) );
+        ready.notify_one();
+    }
+
+    void start() {
+        thread = std::thread( [this]() { run(); } );
+    }
+
+    // prints whatever is still queued, then the last status line
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            closing = true;
+            ready.notify_one();
+        }
+        if( thread.joinable() ) {
+            thread.join();
+        }
+    }
+
+    ~console() {
+        close();
+    }
+
+private:
+
+    void run() {
+        auto next = now() + std::chrono::milliseconds( std::int64_t( interval * 1000 ) );
+        std::unique_lock<std::mutex> lock( mutex );
+        for( bool last = false; !last; ) {
+            auto pending = [&]{ return closing || !lines.empty(); };
+            if( status ) {
+                ready.wait_until( lock, next, pending );
+            } else {
+                ready.wait( lock, pending );
+            }
+            std::deque< std::pair<std::ostream *, std::string> > batch;
+            batch.swap( lines );
+            last = closing;
+            lock.unlock();
+
+            for( auto &l : batch ) {
+                *l.first << l.second;
+            }
+            std::cout.flush();
+            if( status && ( last || now() >= next ) ) {
+                std::string text = status();
+                if( !text.empty() ) {
+                    std::cerr << text << std::endl;
+                }
+                next = now() + std::chrono::milliseconds( std::int64_t( interval * 1000 ) );
+            }
+
+            lock.lock();
+            last = last && lines.empty();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque< std::pair<std::ostream *, std::string> > lines;
+    bool closing = false;
+    std::thread thread;
+};
+
+// a string written by some threads while others read it, such as the texts of the progress window
+struct guarded {
+    guarded &operator=( const std::string &value ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        text = value;
+        return *this;
+    }
+
+    std::string str() const {
+        std::lock_guard<std::mutex> lock( mutex );
+        return text;
+    }
+
+private:
+
+    mutable std::mutex mutex;
+    std::string text;
+};
+
 struct getopt : public std::map< wire::string, wire::string >
 {
     getopt()
@@ -148,29 +437,54 @@ std::string help( const std::string &appname ) {
     cout << "Usage:" << std::endl;
     cout << "\t" << appname << " command archive.zip files[...] [options[...]]" << std::endl;
     cout << "\t" << appname << " command archive.zip @filelist.txt[...] [options[...]]" << std::endl;
+    cout << "\t" << appname << " command archive.zip [masks[...]] [options[...]]   (extract, test, verify and list)" << std::endl;
+    cout << "\t" << appname << " command archive.zip - [options[...]]              (pack standard input as 'stdin')" << std::endl;
+    cout << "\t" << appname << " bench report.csv files[...] [options[...]]        (or report.json)" << std::endl;
     cout << std::endl;
     cout << "Command:" << std::endl;
     cout << "\ta or add                       pack files into archive" << std::endl;
     cout << "\tp or pack                      pack files into archive (same than above)" << std::endl;
     cout << "\tm or move                      move files to archive" << std::endl;
+    cout << "\tu or update                    update archive: add new files, repack modified files, copy unchanged files as they are" << std::endl;
     cout << "\tx or extract                   extract archive" << std::endl;
-    cout << "\tt or test                      test archive" << std::endl;
+    cout << "\tt or test                      test archive: decode every file and compare it against its content checksum" << std::endl;
+    cout << "\tv or verify                    verify archive: compare stored payloads against their checksums, without decoding" << std::endl;
     cout << "\tl or list                      list archive" << std::endl;
+    cout << "\tb or bench                     benchmark encoders on files: throughput, ratio and memory per thread count" << std::endl;
     cout << "Options:" << std::endl;
     cout << "\t-h or --help                   this screen" << std::endl;
-    cout << "\t-v or --verbose                show extra info" << std::endl;
+    cout << "\t-v or --verbose                show extra info, with worker and per-stage timings" << std::endl;
     cout << "\t-b or --bypass-slow SIZE       bypass slow compressors on files larger than given size (in KiB). defaults to 0 (disabled)" << std::endl;
+    cout << "\t-c or --cache FILE             learn encoder choices per file extension in given file, and reuse them on later runs" << std::endl;
+    cout << "\t-D or --dictionary SIZE        train a shared dictionary from the files smaller than SIZE (in KiB), and pack them with it. defaults to 0 (disabled)" << std::endl;
     cout << "\t-d or --delete ENCODER         delete compression encoder from useable list (useful after -u all)" << std::endl;
+    cout << "\t-e or --exclude MASK           skip archived files that match given mask, if using --extract, --test, --verify or --list" << std::endl;
+    cout << "\t-F or --no-filters             do not try the x86/arm, delta and transpose filters ahead of the encoders" << std::endl;
     cout << "\t-f or --flat                   discard path filename information, if using --pack or --move" << std::endl;
-    cout << "\t-i or --ignore PERCENTAGE      ignore compression on files that compress less than given treshold percentage. defaults to 95.0 (percent)" << std::endl;
+    cout << "\t-H or --hash                   also compare file contents when looking for unchanged files, if using --update" << std::endl;
+    cout << "\t-i or --ignore PERCENTAGE      ignore compression on files that compress less than given treshold percentage. defaults to 95.0 (percent); 100 also disables the entropy probe" << std::endl;
+    cout << "\t-k or --chunk SIZE             pack files larger than SIZE in independent chunks of given size (in KiB), in parallel. defaults to 0 (disabled)" << std::endl;
+    cout << "\t-l or --deadline SECS          pick encoders per file from their measured speed, so packing ends within given seconds. defaults to 0 (disabled)" << std::endl;
+    cout << "\t-m or --memory-limit SIZE      run as many jobs concurrently as their estimated memory fits in SIZE (in MiB). defaults to half the physical memory" << std::endl;
+    cout << "\t-n or --repeat NUM             number of measured runs per encoder and thread count, if using --bench. defaults to 3 (runs)" << std::endl;
+    cout << "\t-o or --stdout                 write extracted files to standard output, one after another, if using --extract" << std::endl;
+    cout << "\t-P or --progress FORMAT        report files, bytes in and out, throughput and eta every second on stderr, as text or json (one object per line)" << std::endl;
+    cout << "\t-p or --predict NUM            predict ratios from sampled blocks, then only evaluate the NUM best encoders. defaults to 0 (disabled)" << std::endl;
     cout << "\t-q or --quiet                  be silent, unless errors are found" << std::endl;
+    cout << "\t-R or --throughput RATE        pick encoders per file from their measured speed, so packing keeps given rate (in MiB/s). defaults to 0 (disabled)" << std::endl;
     cout << "\t-r or --recursive              recurse subdirectories" << std::endl;
-    cout << "\t-t or --threads NUM            maximum number of parallel threads, if possible. defaults to 8 (threads)" << std::endl;
+    cout << "\t-s or --solid SIZE             pack files smaller than SIZE/4 together, in solid blocks of given size (in KiB). defaults to 0 (disabled)" << std::endl;
+    cout << "\t-T or --trace FILE             write a timeline of every timed stage to given file, viewable in chrome://tracing" << std::endl;
+    cout << "\t-t or --threads NUM            number of worker threads when packing, extracting or testing (--bench sweeps 1, 2, 4... up to NUM). defaults to 8 (threads)" << std::endl;
     cout << "\t-u or --use ENCODER            use compression encoder = { none, all, lz4, lz4f, zstd, zstdf, lzma20 (default), lzma25, brotli9, brotli11," << std::endl 
          << "\t                               bsc, csc20, shrinker, shoco, miniz, lzip, zpaq, tangelo, zmolly, zling, bcm, mcm, crush, lzjb, bzip2 } (*)" << std::endl;
+    cout << "\t-w or --warmup NUM             number of unmeasured runs before the measured ones, if using --bench. defaults to 1 (runs)" << std::endl;
     cout << std::endl;
     cout << "\t(*): Specify as many encoders as desired. Bundler will evaluate and choose the best compressor for each file." << std::endl;
     cout << std::endl;
+    cout << "\tFiles are walked and packed by several threads: the index lists entries sorted by name, but payloads are laid out" << std::endl;
+    cout << "\tin the order they finish, so packing the same files twice does not give byte-for-byte identical archives." << std::endl;
+    cout << std::endl;
 
     return cout.str();
 }
@@ -184,108 +498,1879 @@ double ratio( const T &A, const U &B ) {
     return ratio;
 }
 
-int main( int argc, const char **argv ) {
-    struct getopt args( argc, argv );
+// streamed .bnd archives. payloads are appended to disk as soon as they are packed, and the index is written last:
+// [payload 0][payload 1]...[payload N][index][index offset: u64][index size: u64][magic: 8 bytes]
+// the index is a regular bundle archive that holds name, offset and size of every payload, but no data.
+#define BUNDLER_STREAM_MAGIC "bndstrm\x01"
 
-    if( args.has("-?") || args.has("-h") || args.has("--help") || args.size() <= 3 ) {
-        std::cout << head(args[0]) << std::endl;
-        std::cout << help(args[0]);
+void put64( std::string &out, std::uint64_t value ) {
+    for( int i = 0; i < 8; ++i ) {
+        out += char( ( value >> ( i * 8 ) ) & 0xff );
+    }
+}
 
-        bubble::show( bubble::string() <<
-            "title.text=About;"
-            "body.icon=8;" //8
-            "head.text=" << BUNDLER_TEXT << ";"
-            "body.text=" << "<a href\a\"" << BUNDLER_URL << "\">" << BUNDLER_URL << "</a>;"
-            "style.minimizable=1;"
-        );
+std::uint64_t get64( const char *ptr ) {
+    std::uint64_t value = 0;
+    for( int i = 7; i >= 0; --i ) {
+        value = ( value << 8 ) | (unsigned char)ptr[i];
+    }
+    return value;
+}
 
-        return 0;
+struct bndwriter {
+    std::ofstream ofs;
+    std::mutex mutex;
+    std::uint64_t offset = 0;
+
+    bool open( const std::string &pathfile ) {
+        ofs.open( pathfile.c_str(), std::ios::binary | std::ios::trunc );
+        offset = 0;
+        return ofs.good();
     }
 
-    const bool moveit = args[1] == "m" || args[1] == "move";
-    const bool packit = args[1] == "p" || args[1] == "pack" || args[1] == "a" || args[1] == "add";
-    const bool testit = args[1] == "t" || args[1] == "test";
-    const bool upckit = args[1] == "x" || args[1] == "extract";
-    const bool listit = args[1] == "l" || args[1] == "list";
+    // thread-safe. returns offset of appended payload
+    bool append( const std::string &payload, std::uint64_t &at ) {
+        auto start = now();
+        std::lock_guard<std::mutex> lock( mutex );
+        at = offset;
+        ofs.write( payload.data(), payload.size() );
+        offset += payload.size();
+        stages.add( profiler::WRITE, start, payload.size() );
+        return ofs.good();
+    }
 
-    std::vector<unsigned> encoders, fast_encoders;
-    const std::string archive = args[2];
-    unsigned max_threads = 8;
+    bool close( const bundle::archive &index ) {
+        auto start = now();
+        std::string trailer = index.bnd();
+        std::uint64_t index_offset = offset, index_size = trailer.size();
+        put64( trailer, index_offset );
+        put64( trailer, index_size );
+        trailer.append( BUNDLER_STREAM_MAGIC, 8 );
+        ofs.write( trailer.data(), trailer.size() );
+        ofs.close();
+        stages.add( profiler::INDEX, start, trailer.size() );
+        return !ofs.fail();
+    }
+};
 
-    const bool flat = args.has("-f") || args.has("--flat");
-    const bool quiet = args.has("-q") || args.has("--quiet");
-    const bool recursive = args.has("-r") || args.has("--recursive");
-    const bool use = args.has("-u") || args.has("--use");
-    const bool verbose = ( args.has("-v") || args.has("--verbose") ) && !quiet;
-    double treshold = 95.00;    // ignore compression settings if compression ratio below of given treshold 
-    size_t lte = 0;             // bypass slow encoders on files larger or equal than given size (in KiB)
+// read-only view of a whole file, mapped in memory
+struct mapping {
+    const char *data = 0;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE, map = 0;
+#endif
 
-    if( !quiet ) {
-        std::cout << head(args[0]) << std::endl;
+    bool open( const std::string &pathfile ) {
+#ifdef _WIN32
+        file = CreateFileA( pathfile.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
+        if( file == INVALID_HANDLE_VALUE ) {
+            return false;
+        }
+        LARGE_INTEGER len;
+        if( !GetFileSizeEx( file, &len ) ) {
+            return false;
+        }
+        size = size_t( len.QuadPart );
+        if( !size ) {
+            return true;
+        }
+        map = CreateFileMappingA( file, 0, PAGE_READONLY, 0, 0, 0 );
+        data = map ? (const char *)MapViewOfFile( map, FILE_MAP_READ, 0, 0, 0 ) : 0;
+        return data != 0;
+#else
+        int fd = ::open( pathfile.c_str(), O_RDONLY );
+        if( fd < 0 ) {
+            return false;
+        }
+        struct stat st;
+        if( fstat( fd, &st ) < 0 ) {
+            ::close( fd );
+            return false;
+        }
+        size = size_t( st.st_size );
+        if( size ) {
+            void *ptr = mmap( 0, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            data = ptr == MAP_FAILED ? 0 : (const char *)ptr;
+        }
+        ::close( fd );
+        return !size || data;
+#endif
     }
 
-    if( verbose ) {
-        std::cout << "options: ";
-        std::cout << "moveit=" << moveit << ',';
-        std::cout << "packit=" << packit << ',';
-        std::cout << "testit=" << testit << ',';
-        std::cout << "xtrcit=" << upckit << ',';
-        std::cout << "archive=" << archive << ',';
-        std::cout << "flat=" << flat << ',';
-        std::cout << "quiet=" << quiet << ',';
-        std::cout << "recursive=" << recursive << ',';
-        std::cout << "use=" << use << ',';
-        std::cout << "verbose=" << verbose << ',';
-        std::cout << "treshold=" << treshold << ',';
-        std::cout << "lte=" << lte;
-        /*
-        std::cout << "args=";
-        for( auto &arg : args ) {
-            std::cout << arg.first << ' ';
+    void close() {
+#ifdef _WIN32
+        if( data ) UnmapViewOfFile( data );
+        if( map ) CloseHandle( map );
+        if( file != INVALID_HANDLE_VALUE ) CloseHandle( file );
+        file = INVALID_HANDLE_VALUE, map = 0;
+#else
+        if( data ) munmap( (void *)data, size );
+#endif
+        data = 0, size = 0;
+    }
+
+    ~mapping() {
+        close();
+    }
+};
+
+// unsigned decimal number of an archive index field. false when it is empty, malformed or out of range, so a corrupt
+// index can be reported instead of throwing
+bool to_u64( const std::string &text, std::uint64_t &value ) {
+    if( text.empty() || text[0] < '0' || text[0] > '9' ) {
+        return false;
+    }
+    char *end = 0;
+    errno = 0;
+    unsigned long long parsed = std::strtoull( text.c_str(), &end, 10 );
+    if( errno == ERANGE || *end ) {
+        return false;
+    }
+    value = std::uint64_t( parsed );
+    return true;
+}
+
+bool to_u32( const std::string &text, std::uint32_t &value ) {
+    std::uint64_t parsed;
+    if( !to_u64( text, parsed ) || parsed > 0xFFFFFFFFULL ) {
+        return false;
+    }
+    value = std::uint32_t( parsed );
+    return true;
+}
+
+// numeric field of an index entry, or `fallback` when it is missing or not a number
+std::uint64_t field_of( bundle::file &entry, const std::string &key, std::uint64_t fallback = 0 ) {
+    std::uint64_t value;
+    return entry.count( key ) && to_u64( entry[ key ], value ) ? value : fallback;
+}
+
+// archive reader. only the index of streamed archives is parsed; payloads are fetched lazily from the mapping.
+// legacy .bnd archives have no separate index, so they are parsed whole.
+struct bndreader {
+    mapping map;
+    bool streamed = false;
+    std::uint64_t index_offset = 0;
+
+    bool open( const std::string &pathfile, bundle::archive &index ) {
+        if( !map.open( pathfile ) ) {
+            return false;
         }
-        */
-        std::cout << std::endl;
+        const char *tail = map.size >= 24 ? map.data + map.size - 24 : 0;
+        streamed = tail && 0 == memcmp( tail + 16, BUNDLER_STREAM_MAGIC, 8 );
+        if( streamed ) {
+            index_offset = get64( tail );
+            std::uint64_t index_size = get64( tail + 8 );
+            if( index_offset + index_size > map.size - 24 ) {
+                return false;
+            }
+            return index.bnd( std::string( map.data + index_offset, size_t( index_size ) ) );
+        }
+        return index.bnd( std::string( map.data, map.size ) );
     }
 
-    int numerrors = 0, processed = 0;
-    std::uint64_t total_input = 0, total_output = 0;
+    bool payload( bundle::file &entry, std::string &out ) const {
+        if( !streamed ) {
+            out = entry["data"];
+            return true;
+        }
+        std::uint64_t offset, size;
+        return to_u64( entry["offset"], offset ) && to_u64( entry["size"], size ) && payload( offset, size, out );
+    }
 
-    if( !moveit && !packit && !testit && !upckit && !listit ) {
-        std::cout << help(args[0]);
-        std::cout << "No command." << std::endl;
-        return -1;
+    // true if given range lies within the payloads, ahead of the index
+    bool holds( std::uint64_t offset, std::uint64_t size ) const {
+        return streamed && size <= index_offset && offset <= index_offset - size;
     }
 
-    bundle::archive archived;
-    sao::folder to_pack;
+    bool payload( std::uint64_t offset, std::uint64_t size, std::string &out ) const {
+        if( !holds( offset, size ) ) {
+            return false;
+        }
+        out.assign( map.data + offset, size_t( size ) );
+        return true;
+    }
 
-    for( int i = 3; args.has(i); ++i ) {
-        if( args[i] == "-f" || args[i] == "--flat" ||
-            args[i] == "-q" || args[i] == "--quiet" ||
-            args[i] == "-r" || args[i] == "--recursive" ||
-            args[i] == "-v" || args[i] == "--verbose" ) {
-            continue;
+    // encoder of given entry, if known
+    std::string encoder( bundle::file &entry ) const {
+        if( entry.count("encoder") ) {
+            return entry["encoder"];
         }
-        if( args[i] == "-t" || args[i] == "--threads" ) {
-            if( args.has(++i) ) {
-                max_threads = args[i].as<unsigned>();
+        if( !streamed && bundle::is_packed( entry["data"] ) ) {
+            return bundle::name_of( bundle::type_of( entry["data"] ) );
+        }
+        return std::string();
+    }
+};
+
+// 64-bit FNV-1a hash of file contents
+std::uint64_t hash64( const std::string &data ) {
+    std::uint64_t h = 14695981039346656037ULL;
+    for( auto &c : data ) {
+        h = ( h ^ (unsigned char)c ) * 1099511628211ULL;
+    }
+    return h;
+}
+
+// content hash of files packed in chunks: hash of every chunk hash, in order
+std::uint64_t hash64( const std::string &data, std::uint64_t chunk ) {
+    if( !chunk || data.size() <= chunk ) {
+        return hash64( data );
+    }
+    std::string hashes;
+    for( std::uint64_t at = 0; at < data.size(); at += chunk ) {
+        put64( hashes, hash64( data.substr( size_t( at ), size_t( chunk ) ) ) );
+    }
+    return hash64( hashes );
+}
+
+// CRC-32C (Castagnoli) of given data, continuing from a previous crc. x86 cpus with SSE4.2 use the crc32
+// instruction, picked at runtime; the others a slicing-by-8 table.
+std::uint32_t crc32c_table( std::uint32_t crc, const unsigned char *p, size_t size ) {
+    static const std::vector<std::uint32_t> table = []() {
+        std::vector<std::uint32_t> t( 8 * 256 );
+        for( unsigned i = 0; i < 256; ++i ) {
+            std::uint32_t c = i;
+            for( int k = 0; k < 8; ++k ) {
+                c = ( c >> 1 ) ^ ( 0x82F63B78 & ( 0u - ( c & 1 ) ) );
             }
-            continue;
-        }        
-        if( args[i] == "-i" || args[i] == "--ignore" ) {
-            if( args.has(++i) ) {
-                treshold = args[i].as<double>();
+            t[i] = c;
+        }
+        for( unsigned i = 0; i < 256; ++i ) {
+            for( unsigned s = 1; s < 8; ++s ) {
+                t[s * 256 + i] = ( t[(s - 1) * 256 + i] >> 8 ) ^ t[ t[(s - 1) * 256 + i] & 0xff ];
             }
+        }
+        return t;
+    }();
+    const std::uint32_t *t = table.data();
+    for( ; size >= 8; p += 8, size -= 8 ) {
+        std::uint32_t lo = crc ^ ( std::uint32_t(p[0]) | std::uint32_t(p[1]) << 8 | std::uint32_t(p[2]) << 16 | std::uint32_t(p[3]) << 24 );
+        std::uint32_t hi = std::uint32_t(p[4]) | std::uint32_t(p[5]) << 8 | std::uint32_t(p[6]) << 16 | std::uint32_t(p[7]) << 24;
+        crc = t[7 * 256 + ( lo & 0xff )] ^ t[6 * 256 + ( ( lo >> 8 ) & 0xff )] ^ t[5 * 256 + ( ( lo >> 16 ) & 0xff )] ^ t[4 * 256 + ( lo >> 24 )]
+            ^ t[3 * 256 + ( hi & 0xff )] ^ t[2 * 256 + ( ( hi >> 8 ) & 0xff )] ^ t[1 * 256 + ( ( hi >> 16 ) & 0xff )] ^ t[hi >> 24];
+    }
+    while( size-- ) {
+        crc = ( crc >> 8 ) ^ t[ ( crc ^ *p++ ) & 0xff ];
+    }
+    return crc;
+}
+
+#ifdef BUNDLER_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+std::uint32_t crc32c_sse42( std::uint32_t crc, const unsigned char *p, size_t size ) {
+#if defined(__x86_64__)
+    std::uint64_t c = crc;
+    for( ; size >= 8; p += 8, size -= 8 ) {
+        std::uint64_t word;
+        memcpy( &word, p, 8 );
+        c = _mm_crc32_u64( c, word );
+    }
+    crc = std::uint32_t( c );
+#endif
+    while( size-- ) {
+        crc = _mm_crc32_u8( crc, *p++ );
+    }
+    return crc;
+}
+#endif
+
+std::uint32_t crc32c( const std::string &data, std::uint32_t crc = 0 ) {
+    const unsigned char *p = (const unsigned char *)data.data();
+#ifdef BUNDLER_CRC32C_SSE42
+    static const bool sse42 = __builtin_cpu_supports( "sse4.2" );
+    if( sse42 ) {
+        return ~crc32c_sse42( ~crc, p, data.size() );
+    }
+#endif
+    return ~crc32c_table( ~crc, p, data.size() );
+}
+
+// reads whole file (or given range of it) into a buffer preallocated to the file size: one open, one copy,
+// no intermediate streams. large reads get sequential read-ahead hints, where available.
+bool readinto( const std::string &pathfile, std::string &out, std::uint64_t offset = 0, std::uint64_t length = ~0ULL ) {
+    auto start = now();
+#ifdef _WIN32
+    std::ifstream ifs( pathfile.c_str(), std::ios::binary | std::ios::ate );
+    if( !ifs.good() ) {
+        return false;
+    }
+    std::uint64_t size = std::uint64_t( ifs.tellg() );
+    offset = offset < size ? offset : size;
+    out.resize( size_t( length < size - offset ? length : size - offset ) );
+    ifs.seekg( offset );
+    bool ok = out.empty() || ifs.read( &out[0], out.size() ).good();
+    stages.add( profiler::READ, start, out.size() );
+    return ok;
+#else
+    int fd = ::open( pathfile.c_str(), O_RDONLY );
+    if( fd < 0 ) {
+        return false;
+    }
+    struct stat st;
+    if( fstat( fd, &st ) < 0 || !S_ISREG( st.st_mode ) ) {
+        ::close( fd );
+        return false;
+    }
+    std::uint64_t size = std::uint64_t( st.st_size );
+    offset = offset < size ? offset : size;
+    out.resize( size_t( length < size - offset ? length : size - offset ) );
+    if( out.size() >= 1024 * 1024 ) {
+#if defined(POSIX_FADV_SEQUENTIAL)
+        posix_fadvise( fd, off_t( offset ), off_t( out.size() ), POSIX_FADV_SEQUENTIAL );
+        posix_fadvise( fd, off_t( offset ), off_t( out.size() ), POSIX_FADV_WILLNEED );
+#elif defined(F_RDAHEAD)
+        fcntl( fd, F_RDAHEAD, 1 );
+#endif
+    }
+    size_t done = 0;
+    while( done < out.size() ) {
+        ssize_t bytes = pread( fd, &out[done], out.size() - done, off_t( offset + done ) );
+        if( bytes < 0 && errno == EINTR ) {
             continue;
-        }        
-        if( args[i] == "-b" || args[i] == "--bypass-slow" ) {
-            if( args.has(++i) ) {
-                lte = args[i].as<unsigned>(); 
+        }
+        if( bytes <= 0 ) {
+            break;
+        }
+        done += size_t( bytes );
+    }
+    ::close( fd );
+    stages.add( profiler::READ, start, done );
+    return done == out.size();
+#endif
+}
+
+// file being extracted. data goes straight to the descriptor in large writes, without stream buffering, and
+// the file is preallocated to its final size when known, so the filesystem can lay it out in one go.
+struct outfile {
+#ifdef _WIN32
+    HANDLE fd = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+
+    bool open( const std::string &pathfile, std::uint64_t size ) {
+#ifdef _WIN32
+        fd = CreateFileA( pathfile.c_str(), GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0 );
+        if( fd == INVALID_HANDLE_VALUE ) {
+            return false;
+        }
+        if( size ) {
+            LARGE_INTEGER at, zero;
+            at.QuadPart = LONGLONG( size ), zero.QuadPart = 0;
+            if( SetFilePointerEx( fd, at, 0, FILE_BEGIN ) ) {
+                SetEndOfFile( fd );
             }
-            continue;
-        }        
-        if( args[i] == "-u" || args[i] == "--use" ) {
-            if( args.has(++i) ) {
+            SetFilePointerEx( fd, zero, 0, FILE_BEGIN );
+        }
+        return true;
+#else
+        fd = ::open( pathfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+        if( fd < 0 ) {
+            return false;
+        }
+#if defined(__linux__) || defined(__FreeBSD__)
+        if( size ) {
+            posix_fallocate( fd, 0, off_t( size ) );
+        }
+#endif
+        return true;
+#endif
+    }
+
+    bool write( const char *data, size_t size ) {
+        while( size ) {
+#ifdef _WIN32
+            DWORD chunk = DWORD( size < ( 1u << 30 ) ? size : ( 1u << 30 ) ), written = 0;
+            if( !WriteFile( fd, data, chunk, &written, 0 ) || !written ) {
+                return false;
+            }
+#else
+            ssize_t written = ::write( fd, data, size );
+            if( written < 0 && errno == EINTR ) {
+                continue;
+            }
+            if( written <= 0 ) {
+                return false;
+            }
+#endif
+            data += written, size -= size_t( written );
+        }
+        return true;
+    }
+
+    bool is_open() const {
+#ifdef _WIN32
+        return fd != INVALID_HANDLE_VALUE;
+#else
+        return fd >= 0;
+#endif
+    }
+
+    // truncates to the bytes actually written, in case the preallocated size was wrong
+    bool close() {
+        bool ok = is_open();
+#ifdef _WIN32
+        ok = ok && SetEndOfFile( fd ) && CloseHandle( fd );
+        fd = INVALID_HANDLE_VALUE;
+#else
+        if( ok ) {
+            off_t at = lseek( fd, 0, SEEK_CUR );
+            ok = at >= 0 && 0 == ftruncate( fd, at );
+            ok = 0 == ::close( fd ) && ok;
+        }
+        fd = -1;
+#endif
+        return ok;
+    }
+
+    ~outfile() {
+        if( is_open() ) {
+            close();
+        }
+    }
+};
+
+// tells whether input is already compressed, without running any encoder: a few blocks sampled across the input
+// must all be close to 8 bits of entropy per byte. inputs starting with the signature of a known compressed format
+// (archives, compressed streams, media) only need to be fairly close.
+bool incompressible( const std::string &input ) {
+    const size_t block = 16 * 1024, blocks = 8;
+
+    // inputs this small are cheap enough to just try
+    if( input.size() < block * 4 ) {
+        return false;
+    }
+
+    static const struct { size_t at; const char *magic; size_t len; } formats[] = {
+        { 0, "PK\x03\x04", 4 }, { 0, "\x1f\x8b", 2 }, { 0, "BZh", 3 }, { 0, "\xfd" "7zXZ\x00", 6 }, { 0, "7z\xbc\xaf\x27\x1c", 6 },
+        { 0, "\x28\xb5\x2f\xfd", 4 }, { 0, "\x04\x22\x4d\x18", 4 }, { 0, "Rar!", 4 }, { 0, "\xff\xd8\xff", 3 }, { 0, "\x89PNG", 4 },
+        { 0, "GIF8", 4 }, { 0, "RIFF", 4 }, { 4, "ftyp", 4 }, { 0, "\x1a\x45\xdf\xa3", 4 }, { 0, "ID3", 3 }, { 0, "OggS", 4 }, { 0, "fLaC", 4 },
+    };
+    bool known = bundle::is_packed( input );
+    for( auto &f : formats ) {
+        known = known || 0 == input.compare( f.at, f.len, f.magic, f.len );
+    }
+
+    // estimates of a 16 KiB sample fall about 0.01 bits short of 8 on random data
+    const double floor = known ? 7.2 : 7.9;
+    for( size_t i = 0; i < blocks; ++i ) {
+        const unsigned char *p = (const unsigned char *)&input[ ( input.size() - block ) * i / ( blocks - 1 ) ];
+
+        // four interleaved histograms, so consecutive equal bytes do not stall on the same counter
+        std::uint32_t counts[4][256] = {};
+        for( size_t j = 0; j < block; j += 4 ) {
+            counts[0][ p[j+0] ]++;
+            counts[1][ p[j+1] ]++;
+            counts[2][ p[j+2] ]++;
+            counts[3][ p[j+3] ]++;
+        }
+
+        double bits = 0;
+        for( unsigned c = 0; c < 256; ++c ) {
+            std::uint32_t n = counts[0][c] + counts[1][c] + counts[2][c] + counts[3][c];
+            if( n ) {
+                double f = double( n ) / block;
+                bits -= f * std::log2( f );
+            }
+        }
+        if( bits < floor ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// buffers owned by a worker, reused from job to job: once warm, the payload-sized buffers (read, packed, verified,
+// filtered, sampled) are not reallocated. bookkeeping is not covered: encoder lists, rankings, labels and index fields
+// are still small allocations per job. buffers grown past `keep` bytes are released after the job, so one huge file
+// does not pin its memory.
+struct arena {
+    std::string input, block, filtered, unpacked;
+    std::string sample, trial, plain, packed;   // scratch of filter::pick() and predict()
+    std::vector<bundle::measure> measures;
+
+    void trim( size_t keep = 64 * 1024 * 1024 ) {
+        for( auto *buf : { &input, &block, &filtered, &unpacked, &sample, &trial, &plain, &packed } ) {
+            if( buf->capacity() > keep ) {
+                std::string().swap( *buf );
+            }
+        }
+        for( auto &m : measures ) {
+            if( m.packed.capacity() > keep ) {
+                std::string().swap( m.packed );
+            }
+        }
+    }
+};
+
+// predicts packing ratio of every encoder by packing a few blocks sampled across the input, then returns the
+// `keep` most promising encoders (best first). predicted ratios are stored in `estimates`, by encoder.
+// the sample and its trial packs live in the buffers of given arena.
+std::vector<unsigned> predict( const std::string &input, const std::vector<unsigned> &encoders, unsigned keep, std::map<unsigned, double> &estimates, arena &buf ) {
+    const size_t block = 16 * 1024, blocks = 4;
+
+    // inputs this small are cheaper to measure for real
+    if( keep >= encoders.size() || input.size() <= block * blocks ) {
+        return encoders;
+    }
+
+    std::string &sample = buf.sample, &packed = buf.packed;
+    sample.clear();
+    for( size_t i = 0; i < blocks; ++i ) {
+        sample.append( input, ( input.size() - block ) * i / ( blocks - 1 ), block );
+    }
+
+    std::vector< std::pair<size_t, unsigned> > ranked;
+    for( auto &q : encoders ) {
+        size_t size = bundle::pack( q, packed, sample ) ? packed.size() : ~size_t(0);
+        estimates[ q ] = ratio( sample.size(), size );
+        ranked.push_back( std::make_pair( size, q ) );
+    }
+    std::stable_sort( ranked.begin(), ranked.end() );
+
+    std::vector<unsigned> shortlist;
+    for( unsigned i = 0; i < keep; ++i ) {
+        shortlist.push_back( ranked[i].second );
+    }
+    return shortlist;
+}
+
+// encoder decisions learned on previous runs, keyed by file extension and persisted as a text file.
+// each line reads: extension files ignored ratio_sum [encoder=wins...]
+struct learncache {
+    struct stats {
+        unsigned files = 0, ignored = 0, probes = 0;
+        double ratio = 0;
+        std::map<std::string, unsigned> wins;
+    };
+
+    std::map<std::string, stats> classes;
+    std::mutex mutex;
+
+    enum { min_samples = 8, shortlisted = 2, probe_every = 32 };
+
+    static std::string key( const std::string &pathfile ) {
+        auto slash = pathfile.find_last_of("/\\");
+        auto dot = pathfile.find_last_of('.');
+        if( dot == std::string::npos || ( slash != std::string::npos && dot < slash ) ) {
+            return ".";
+        }
+        return wire::string( pathfile.substr( dot ) ).lowercase();
+    }
+
+    bool load( const std::string &pathfile ) {
+        std::ifstream ifs( pathfile.c_str() );
+        std::string line;
+        while( std::getline( ifs, line ) ) {
+            std::stringstream ss( line );
+            std::string ext, win;
+            stats st;
+            if( ss >> ext >> st.files >> st.ignored >> st.ratio ) {
+                while( ss >> win ) {
+                    auto eq = win.find('=');
+                    if( eq != std::string::npos ) {
+                        st.wins[ win.substr( 0, eq ) ] = wire::string( win.substr( eq + 1 ) ).as<unsigned>();
+                    }
+                }
+                classes[ ext ] = st;
+            }
+        }
+        return ifs.eof();
+    }
+
+    bool save( const std::string &pathfile ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        std::string tmpfile = pathfile + ".tmp";
+        {
+            std::ofstream ofs( tmpfile.c_str(), std::ios::trunc );
+            for( auto &it : classes ) {
+                ofs << it.first << ' ' << it.second.files << ' ' << it.second.ignored << ' ' << it.second.ratio;
+                for( auto &win : it.second.wins ) {
+                    ofs << ' ' << win.first << '=' << win.second;
+                }
+                ofs << std::endl;
+            }
+            if( !ofs.good() ) {
+                return false;
+            }
+        }
+#ifdef _WIN32
+        std::remove( pathfile.c_str() );
+#endif
+        return 0 == std::rename( tmpfile.c_str(), pathfile.c_str() );
+    }
+
+    // filters candidate encoders for given file class. an empty list means the class is known not to compress.
+    // every few files of a skipped class are still measured, so the cache can notice when data changes.
+    std::vector<unsigned> shortlist( const std::string &ext, const std::vector<unsigned> &candidates ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        auto found = classes.find( ext );
+        if( found == classes.end() || found->second.files < min_samples ) {
+            return candidates;
+        }
+        auto &st = found->second;
+        if( st.ignored == st.files ) {
+            return ( ++st.probes % probe_every ) ? std::vector<unsigned>() : candidates;
+        }
+        std::vector< std::pair<unsigned, unsigned> > ranked;
+        for( auto &q : candidates ) {
+            auto win = st.wins.find( bundle::name_of(q) );
+            if( win != st.wins.end() ) {
+                ranked.push_back( std::make_pair( win->second, q ) );
+            }
+        }
+        if( ranked.empty() ) {
+            return candidates;
+        }
+        std::stable_sort( ranked.begin(), ranked.end(), []( const std::pair<unsigned, unsigned> &a, const std::pair<unsigned, unsigned> &b ) {
+            return a.first > b.first;
+        } );
+        std::vector<unsigned> list;
+        for( unsigned i = 0; i < ranked.size() && i < shortlisted; ++i ) {
+            list.push_back( ranked[i].second );
+        }
+        return list;
+    }
+
+    // records winner encoder for given file class (empty if file was stored uncompressed)
+    void learn( const std::string &ext, const std::string &encoder, double ratio ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        auto &st = classes[ ext ];
+        st.files++;
+        st.ratio += ratio;
+        if( encoder.empty() ) {
+            st.ignored++;
+        } else {
+            st.wins[ encoder ]++;
+        }
+    }
+};
+
+// encoder speeds and ratios measured on this run, used to keep pace with a throughput target or a deadline.
+// every input gets the fastest encoder known so far, plus the best packing ones that fit in the time the target
+// allows for it. encoders not measured yet are tried on small inputs first, so large ones never wait on them.
+struct pacer {
+    struct stats {
+        double bytes = 0, secs = 0, packed = 0;
+    };
+
+    std::map<unsigned, stats> measured;
+    std::mutex mutex;
+
+    double throughput = 0; // target, in bytes per second (0 = none)
+    double deadline = 0;   // target, in seconds since start (0 = none)
+    unsigned workers = 1;
+    std::atomic<std::uint64_t> found { 0 }, done { 0 }; // input bytes seen by the scanner, and packed so far
+
+    enum { probe_size = 256 * 1024 };
+
+    bool enabled() const {
+        return throughput > 0 || deadline > 0;
+    }
+
+    // time spent by every encoder on an input of `len` bytes, including the decoding check
+    void learn( const std::vector<bundle::measure> &measures, std::uint64_t len ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        for( auto &m : measures ) {
+            if( m.pass ) {
+                auto &st = measured[ m.q ];
+                st.bytes += len;
+                st.secs += ( m.enctime + m.dectime ) / 1e6;
+                st.packed += m.packed.size();
+            }
+        }
+    }
+
+    std::vector<unsigned> plan( const std::vector<unsigned> &candidates, std::uint64_t len, double elapsed ) {
+        if( !enabled() || candidates.size() <= 1 ) {
+            return candidates;
+        }
+
+        // the rate this input must be packed at: whatever the target is, or whatever is left to reach the deadline
+        double rate = throughput;
+        if( deadline > 0 ) {
+            std::uint64_t remaining = found > done ? found - done : len;
+            double left = deadline - elapsed;
+            rate = left > 0 ? (std::max)( rate, remaining / left ) : 1e300;
+        }
+        const double budget = rate > 0 ? double( len ) * workers / rate : 1e300; // seconds on one worker
+
+        std::lock_guard<std::mutex> lock( mutex );
+        std::vector<unsigned> known, unknown;
+        for( auto &q : candidates ) {
+            ( measured.count( q ) ? known : unknown ).push_back( q );
+        }
+        if( known.empty() ) {
+            return candidates;
+        }
+
+        auto secs = [&]( unsigned q ) {
+            return len * measured[q].secs / (std::max)( measured[q].bytes, 1.0 );
+        };
+        auto packs = [&]( unsigned q ) {
+            return measured[q].packed / (std::max)( measured[q].bytes, 1.0 );
+        };
+
+        std::stable_sort( known.begin(), known.end(), [&]( unsigned a, unsigned b ) { return secs( a ) < secs( b ); } );
+        std::map<unsigned, bool> chosen;
+        chosen[ known[0] ] = true;
+        double spent = secs( known[0] );
+
+        std::stable_sort( known.begin() + 1, known.end(), [&]( unsigned a, unsigned b ) { return packs( a ) < packs( b ); } );
+        for( size_t i = 1; i < known.size(); ++i ) {
+            if( spent + secs( known[i] ) <= budget ) {
+                chosen[ known[i] ] = true;
+                spent += secs( known[i] );
+            }
+        }
+        for( auto &q : unknown ) {
+            if( len <= probe_size ) {
+                chosen[ q ] = true;
+            }
+        }
+
+        // candidates keep their order, as the first one is the preferred one
+        std::vector<unsigned> plan;
+        for( auto &q : candidates ) {
+            if( chosen.count( q ) ) {
+                plan.push_back( q );
+            }
+        }
+        return plan;
+    }
+
+    std::string report() {
+        std::lock_guard<std::mutex> lock( mutex );
+        std::stringstream ss;
+        for( auto &m : measured ) {
+            ss << "encoder " << bundle::name_of( m.first ) << ": " << ( m.second.bytes / (std::max)( m.second.secs, 1e-6 ) / 1e6 ) << " MB/s, "
+               << ratio( m.second.bytes, m.second.packed ) << "% on " << std::uint64_t( m.second.bytes ) << " bytes" << std::endl;
+        }
+        return ss.str();
+    }
+};
+
+// shared dictionary for small files: the tokens found most often across a sample of files. a token is a run of bytes
+// that ends at a delimiter, so keys and markup of structured text (json, xml, logs...) are picked whole.
+// every token is replaced with an escape byte plus its index; the escape byte is the rarest byte of the sample, and
+// literal escape bytes are followed by 255. the dictionary is stored once, so tiny files do not carry it themselves.
+struct dictionary {
+    enum { min_token = 4, max_token = 64, max_tokens = 255 };
+
+    unsigned char escape = 0;
+    std::vector<std::string> tokens;
+    std::vector< std::vector<unsigned char> > heads; // tokens by their first two bytes, longest first
+
+    static bool delimiter( unsigned char c ) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == ',' || c == ':' || c == ';' || c == '=' || c == '>' || c == '&' || c == '/';
+    }
+
+    bool train( const std::vector<std::string> &samples ) {
+        std::uint64_t freq[256] = {};
+        struct stats { std::uint64_t hits = 0, files = 0; size_t last = ~size_t(0); };
+        std::map<std::string, stats> counts;
+        for( size_t f = 0; f < samples.size(); ++f ) {
+            const std::string &sample = samples[f];
+            for( size_t begin = 0, i = 0; i < sample.size(); ++i ) {
+                freq[ (unsigned char)sample[i] ]++;
+                if( delimiter( sample[i] ) || i + 1 == sample.size() ) {
+                    size_t len = i + 1 - begin;
+                    if( len >= min_token && len <= max_token ) {
+                        auto &st = counts[ sample.substr( begin, len ) ];
+                        st.hits++;
+                        st.files += st.last != f;
+                        st.last = f;
+                    }
+                    begin = i + 1;
+                }
+            }
+        }
+
+        escape = (unsigned char)( std::min_element( freq, freq + 256 ) - freq );
+
+        // a token pays off when found in several files: score is the bytes it saves over the whole sample
+        std::vector< std::pair<std::uint64_t, std::string> > ranked;
+        for( auto &c : counts ) {
+            if( c.second.files >= 2 ) {
+                ranked.push_back( std::make_pair( ( c.first.size() - 2 ) * c.second.hits, c.first ) );
+            }
+        }
+        std::sort( ranked.begin(), ranked.end(), []( const std::pair<std::uint64_t, std::string> &a, const std::pair<std::uint64_t, std::string> &b ) {
+            return a.first > b.first || ( a.first == b.first && a.second < b.second );
+        } );
+
+        tokens.clear();
+        for( size_t i = 0; i < ranked.size() && i < max_tokens; ++i ) {
+            tokens.push_back( ranked[i].second );
+        }
+        index();
+        return !tokens.empty();
+    }
+
+    // [escape][count] then [length][bytes] per token
+    std::string save() const {
+        std::string out;
+        out += char( escape );
+        out += char( tokens.size() );
+        for( auto &t : tokens ) {
+            out += char( t.size() );
+            out += t;
+        }
+        return out;
+    }
+
+    bool load( const std::string &in ) {
+        tokens.clear();
+        if( in.size() < 2 ) {
+            return false;
+        }
+        escape = (unsigned char)in[0];
+        size_t count = (unsigned char)in[1], at = 2;
+        while( tokens.size() < count && at < in.size() ) {
+            size_t len = (unsigned char)in[at++];
+            if( len < 2 || at + len > in.size() ) {
+                return false;
+            }
+            tokens.push_back( in.substr( at, len ) );
+            at += len;
+        }
+        index();
+        return tokens.size() == count && count < 256;
+    }
+
+    void encode( const std::string &in, std::string &out ) const {
+        out.clear();
+        out.reserve( in.size() );
+        for( size_t i = 0, end = in.size(); i < end; ) {
+            bool matched = false;
+            if( i + 1 < end ) {
+                for( auto &t : heads[ (unsigned char)in[i] << 8 | (unsigned char)in[i+1] ] ) {
+                    const std::string &token = tokens[t];
+                    if( token.size() <= end - i && 0 == memcmp( &in[i], token.data(), token.size() ) ) {
+                        out += char( escape );
+                        out += char( t );
+                        i += token.size();
+                        matched = true;
+                        break;
+                    }
+                }
+            }
+            if( !matched ) {
+                out += in[i];
+                if( (unsigned char)in[i++] == escape ) {
+                    out += char( 255 );
+                }
+            }
+        }
+    }
+
+    bool decode( const std::string &in, std::string &out ) const {
+        out.clear();
+        out.reserve( in.size() * 2 );
+        for( size_t i = 0, end = in.size(); i < end; ++i ) {
+            if( (unsigned char)in[i] != escape ) {
+                out += in[i];
+                continue;
+            }
+            if( ++i == end ) {
+                return false;
+            }
+            unsigned code = (unsigned char)in[i];
+            if( code == 255 ) {
+                out += char( escape );
+            } else if( code < tokens.size() ) {
+                out += tokens[code];
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+
+    void index() {
+        heads.assign( 65536, std::vector<unsigned char>() );
+        for( size_t t = 0; t < tokens.size(); ++t ) {
+            heads[ (unsigned char)tokens[t][0] << 8 | (unsigned char)tokens[t][1] ].push_back( (unsigned char)t );
+        }
+        for( auto &h : heads ) {
+            std::stable_sort( h.begin(), h.end(), [&]( unsigned char a, unsigned char b ) {
+                return tokens[a].size() > tokens[b].size();
+            } );
+        }
+    }
+};
+
+// reversible filters that run ahead of the encoders. none of them changes the size of the data.
+// - x86, arm, arm64: relative branch targets of executables become absolute, so calls to the same function repeat.
+// - deltaN: every byte minus the byte N positions before, for tables of slowly changing numbers.
+// - transposeN: the bytes of N-byte records regrouped by position within the record, so similar columns sit together.
+struct filter {
+    enum { NONE, X86, ARM, ARM64, DELTA, TRANSPOSE };
+
+    int kind = NONE;
+    unsigned stride = 0;
+
+    std::string name() const {
+        switch( kind ) {
+            case X86: return "x86";
+            case ARM: return "arm";
+            case ARM64: return "arm64";
+            case DELTA: return "delta" + std::to_string( stride );
+            case TRANSPOSE: return "transpose" + std::to_string( stride );
+        }
+        return std::string();
+    }
+
+    bool parse( const std::string &text ) {
+        kind = NONE, stride = 0;
+        if( text == "x86" ) kind = X86;
+        else if( text == "arm" ) kind = ARM;
+        else if( text == "arm64" ) kind = ARM64;
+        else if( 0 == text.compare( 0, 5, "delta" ) ) kind = DELTA, stride = unsigned( std::strtoul( &text[5], 0, 10 ) );
+        else if( 0 == text.compare( 0, 9, "transpose" ) ) kind = TRANSPOSE, stride = unsigned( std::strtoul( &text[9], 0, 10 ) );
+        return kind != NONE && ( kind < DELTA || ( stride > 0 && stride <= 256 ) );
+    }
+
+    void apply( const std::string &in, std::string &out ) const {
+        convert( in, out, true );
+    }
+
+    void revert( const std::string &in, std::string &out ) const {
+        convert( in, out, false );
+    }
+
+    // executables are told by their headers. other inputs are tried with every delta and transpose stride on a sample,
+    // by the order-0 entropy each one leaves: the best one is only kept if a trial pack of the sample confirms it.
+    // the sample and the trials live in the buffers of given arena.
+    static filter pick( const std::string &input, unsigned q, arena &buf ) {
+        filter best;
+        if( input.size() < 16 * 1024 ) {
+            return best;
+        }
+
+        const size_t block = (std::min)( input.size(), size_t( 64 * 1024 ) );
+        std::string &sample = buf.sample, &trial = buf.trial;
+        sample.assign( input, ( input.size() - block ) / 2, block );
+
+        best.kind = executable( input );
+        if( best.kind == NONE ) {
+            double floor = 0.85 * entropy( sample, 1 );
+            for( unsigned k : { 1, 2, 4, 8 } ) {
+                filter f;
+                f.kind = DELTA, f.stride = k;
+                f.apply( sample, trial );
+                double bits = entropy( trial, 1 );
+                if( bits < floor ) {
+                    best = f, floor = bits;
+                }
+            }
+            for( unsigned k : { 2, 4, 8 } ) {
+                double bits = entropy( sample, k );
+                if( bits < floor ) {
+                    best.kind = TRANSPOSE, best.stride = k, floor = bits;
+                }
+            }
+        }
+
+        if( best.kind != NONE ) {
+            best.apply( sample, trial );
+            bool smaller = bundle::pack( q, buf.plain, sample ) && bundle::pack( q, buf.packed, trial ) && buf.packed.size() < buf.plain.size();
+            if( !smaller ) {
+                best = filter();
+            }
+        }
+        return best;
+    }
+
+private:
+
+    // order-0 entropy in bits per byte, with bytes split in `lanes` interleaved columns that are measured apart
+    static double entropy( const std::string &data, unsigned lanes ) {
+        std::vector<std::uint32_t> counts( 256 * lanes );
+        for( size_t i = 0; i < data.size(); ++i ) {
+            counts[ ( i % lanes ) * 256 + (unsigned char)data[i] ]++;
+        }
+        double bits = 0;
+        for( unsigned l = 0; l < lanes; ++l ) {
+            std::uint32_t total = 0;
+            for( unsigned c = 0; c < 256; ++c ) {
+                total += counts[ l * 256 + c ];
+            }
+            for( unsigned c = 0; c < 256 && total; ++c ) {
+                if( std::uint32_t n = counts[ l * 256 + c ] ) {
+                    bits -= n * std::log2( double( n ) / total );
+                }
+            }
+        }
+        return data.empty() ? 0 : bits / data.size();
+    }
+
+    static unsigned get16( const std::string &data, size_t at ) {
+        return at + 2 <= data.size() ? (unsigned char)data[at] | (unsigned char)data[at+1] << 8 : 0;
+    }
+
+    static std::uint32_t get32( const std::string &data, size_t at ) {
+        return at + 4 <= data.size() ? std::uint32_t( get16( data, at ) ) | std::uint32_t( get16( data, at + 2 ) ) << 16 : 0;
+    }
+
+    // architecture of little-endian PE, ELF and Mach-O executables
+    static int executable( const std::string &data ) {
+        unsigned machine = 0;
+        if( 0 == data.compare( 0, 2, "MZ" ) ) {
+            size_t pe = get32( data, 0x3C );
+            if( pe < data.size() && 0 == data.compare( pe, 4, std::string( "PE\0\0", 4 ) ) ) {
+                machine = get16( data, pe + 4 );
+                return machine == 0x14C || machine == 0x8664 ? X86 : machine == 0x1C0 || machine == 0x1C4 ? ARM : machine == 0xAA64 ? ARM64 : NONE;
+            }
+        }
+        if( 0 == data.compare( 0, 4, "\x7f" "ELF" ) && data.size() > 5 && data[5] == 1 ) {
+            machine = get16( data, 18 );
+            return machine == 0x03 || machine == 0x3E ? X86 : machine == 0x28 ? ARM : machine == 0xB7 ? ARM64 : NONE;
+        }
+        if( get32( data, 0 ) == 0xFEEDFACE || get32( data, 0 ) == 0xFEEDFACF ) {
+            machine = get32( data, 4 );
+            return machine == 0x7 || machine == 0x1000007 ? X86 : machine == 0xC ? ARM : machine == 0x100000C ? ARM64 : NONE;
+        }
+        return NONE;
+    }
+
+    void convert( const std::string &in, std::string &out, bool encode ) const {
+        const size_t n = in.size();
+        const unsigned char *src = (const unsigned char *)in.data();
+
+        if( kind == TRANSPOSE || kind == DELTA ) {
+            out.resize( n );
+            unsigned char *dst = (unsigned char *)&out[0];
+            const size_t k = stride;
+            if( kind == TRANSPOSE ) {
+                const size_t rows = n / k;
+                for( size_t l = 0; l < k; ++l ) {
+                    for( size_t r = 0; r < rows; ++r ) {
+                        if( encode ) dst[ l * rows + r ] = src[ r * k + l ];
+                        else dst[ r * k + l ] = src[ l * rows + r ];
+                    }
+                }
+                memcpy( dst + rows * k, src + rows * k, n - rows * k );
+            } else if( encode ) {
+                for( size_t i = 0; i < n; ++i ) {
+                    dst[i] = (unsigned char)( src[i] - ( i >= k ? src[i-k] : 0 ) );
+                }
+            } else {
+                for( size_t i = 0; i < n; ++i ) {
+                    dst[i] = (unsigned char)( src[i] + ( i >= k ? dst[i-k] : 0 ) );
+                }
+            }
+            return;
+        }
+
+        // branch filters rewrite the data in place. the bytes that tell a branch are never changed, and converted
+        // targets keep the range their originals had, so both directions find the same branches.
+        out = in;
+        unsigned char *p = (unsigned char *)&out[0];
+        if( kind == X86 ) {
+            // e8/e9 call and jump, with a 32-bit displacement. the four bytes after every e8/e9 are skipped whether
+            // converted or not, so later conversions never touch bytes an earlier decision was made on. only
+            // displacements that fit in 25 signed bits are converted, and they still do afterwards.
+            for( size_t i = 0; i + 5 <= n; ) {
+                if( ( p[i] & 0xFE ) != 0xE8 ) {
+                    ++i;
+                    continue;
+                }
+                if( p[i+4] != 0x00 && p[i+4] != 0xFF ) {
+                    i += 5;
+                    continue;
+                }
+                std::uint32_t v = std::uint32_t( p[i+1] ) | std::uint32_t( p[i+2] ) << 8 | std::uint32_t( p[i+3] ) << 16 | std::uint32_t( p[i+4] ) << 24;
+                std::uint32_t at = std::uint32_t( i + 5 );
+                v = ( encode ? v + at : v - at ) & 0x1FFFFFF;
+                v |= v & 0x1000000 ? 0xFE000000 : 0;
+                for( int b = 0; b < 4; ++b ) {
+                    p[i+1+b] = (unsigned char)( v >> ( b * 8 ) );
+                }
+                i += 5;
+            }
+        } else if( kind == ARM ) {
+            // bl, with a 24-bit word offset relative to pc+8
+            for( size_t i = 0; i + 4 <= n; i += 4 ) {
+                if( p[i+3] == 0xEB ) {
+                    std::uint32_t v = std::uint32_t( p[i] ) | std::uint32_t( p[i+1] ) << 8 | std::uint32_t( p[i+2] ) << 16;
+                    std::uint32_t at = std::uint32_t( ( i + 8 ) >> 2 );
+                    v = ( encode ? v + at : v - at ) & 0xFFFFFF;
+                    p[i] = (unsigned char)v, p[i+1] = (unsigned char)( v >> 8 ), p[i+2] = (unsigned char)( v >> 16 );
+                }
+            }
+        } else if( kind == ARM64 ) {
+            // bl, with a 26-bit word offset
+            for( size_t i = 0; i + 4 <= n; i += 4 ) {
+                std::uint32_t w = std::uint32_t( p[i] ) | std::uint32_t( p[i+1] ) << 8 | std::uint32_t( p[i+2] ) << 16 | std::uint32_t( p[i+3] ) << 24;
+                if( ( w & 0xFC000000 ) == 0x94000000 ) {
+                    std::uint32_t at = std::uint32_t( i >> 2 );
+                    w = 0x94000000 | ( ( encode ? w + at : w - at ) & 0x3FFFFFF );
+                    for( int b = 0; b < 4; ++b ) {
+                        p[i+b] = (unsigned char)( w >> ( b * 8 ) );
+                    }
+                }
+            }
+        }
+    }
+};
+
+// rough working set of an encoder when packing `len` bytes (in bytes). dictionary and model sizes come from
+// the settings each library is built with in bundle; block-sorting encoders scale with their input instead.
+std::uint64_t workingset( unsigned q, std::uint64_t len ) {
+    const std::uint64_t MiB = 1024 * 1024;
+    switch( q ) {
+        default:              return   8 * MiB;
+        case bundle::RAW:
+        case bundle::SHOCO:   return   0;
+        case bundle::LZ4:
+        case bundle::LZ4F:
+        case bundle::LZJB:
+        case bundle::SHRINKER:
+        case bundle::MINIZ:   return   1 * MiB;
+        case bundle::BZIP2:   return   8 * MiB;
+        case bundle::ZSTD:
+        case bundle::ZSTDF:   return  16 * MiB;
+        case bundle::CRUSH:
+        case bundle::ZLING:   return  32 * MiB;
+        case bundle::LZMA20:  return  12 * MiB;
+        case bundle::LZMA25:  return 384 * MiB;
+        case bundle::LZIP:    return  96 * MiB;
+        case bundle::CSC20:   return  32 * MiB;
+        case bundle::BROTLI9: return  64 * MiB;
+        case bundle::BROTLI11:return 192 * MiB;
+        case bundle::TANGELO:
+        case bundle::ZMOLLY:  return  64 * MiB;
+        case bundle::ZPAQ:
+        case bundle::MCM:     return 256 * MiB;
+        case bundle::BSC:
+        case bundle::BCM:     return  16 * MiB + 6 * len;
+    }
+}
+
+// encoder id of given encoder name, or RAW
+unsigned encoder_of( const std::string &name ) {
+    for( auto &q : bundle::encodings() ) {
+        if( name == bundle::name_of(q) ) {
+            return q;
+        }
+    }
+    return bundle::RAW;
+}
+
+// physical memory installed (in bytes), or 0 if unknown
+std::uint64_t physical_memory() {
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    return GlobalMemoryStatusEx( &status ) ? std::uint64_t( status.ullTotalPhys ) : 0;
+#elif defined(_SC_PHYS_PAGES) && defined(_SC_PAGE_SIZE)
+    long pages = sysconf( _SC_PHYS_PAGES ), size = sysconf( _SC_PAGE_SIZE );
+    return pages > 0 && size > 0 ? std::uint64_t( pages ) * std::uint64_t( size ) : 0;
+#else
+    return 0;
+#endif
+}
+
+// restarts the peak resident memory count of this process, so peak_rss() covers only what runs next.
+// only Linux can do this (clear_refs); elsewhere the peak is process-lifetime and false is returned
+bool reset_peak_rss() {
+#if defined(__linux__)
+    std::ofstream ofs( "/proc/self/clear_refs" );
+    return ofs && ( ofs << "5" ).flush();
+#else
+    return false;
+#endif
+}
+
+// peak resident memory of this process (in bytes) since start or last reset_peak_rss(), or 0 if unknown
+std::uint64_t peak_rss() {
+#ifdef _WIN32
+    return 0;
+#else
+#if defined(__linux__)
+    std::ifstream ifs( "/proc/self/status" );
+    for( std::string line; std::getline( ifs, line ); ) {
+        if( line.compare( 0, 6, "VmHWM:" ) == 0 ) {
+            return std::strtoull( line.c_str() + 6, 0, 10 ) * 1024;
+        }
+    }
+#endif
+    struct rusage usage;
+    if( 0 != getrusage( RUSAGE_SELF, &usage ) ) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return std::uint64_t( usage.ru_maxrss );
+#else
+    return std::uint64_t( usage.ru_maxrss ) * 1024;
+#endif
+#endif
+}
+
+// walks the given paths with a few threads of its own: every directory found is queued, so subtrees are listed
+// concurrently. files are handed out through next() as soon as they are found, so packing starts while the walk goes on.
+struct scanner {
+    explicit
+    scanner( unsigned num_threads, bool recursive ) : recursive(recursive), busy(0), closed(false), found(0) {
+        num_threads = num_threads ? num_threads : 1;
+        for( unsigned i = 0; i < num_threads; ++i ) {
+            threads.emplace_back( [this]() { run(); } );
+        }
+    }
+
+    // regular file found by the walk, stat'ed once by the walker thread that found it
+    struct file {
+        std::string path;
+        std::uint64_t size, mtime;
+    };
+
+    ~scanner() {
+        close();
+        file found;
+        while( next( found ) ) {
+        }
+        for( auto &in : threads ) {
+            if( in.joinable() ) {
+                in.join();
+            }
+        }
+    }
+
+    // file, directory or wildcard mask
+    void include( const std::string &path ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        pending.push_back( task { path, false } );
+        wakeup.notify_one();
+    }
+
+    // no more paths will be included
+    void close() {
+        std::lock_guard<std::mutex> lock( mutex );
+        closed = true;
+        wakeup.notify_all();
+        ready.notify_all();
+    }
+
+    // next file found. blocks until there is one, or returns false once the walk is over
+    bool next( file &found ) {
+        std::unique_lock<std::mutex> lock( mutex );
+        ready.wait( lock, [&]{ return !files.empty() || over(); } );
+        if( files.empty() ) {
+            return false;
+        }
+        found = std::move( files.front() );
+        files.pop_front();
+        return true;
+    }
+
+    // paths left out of the walk so far, each with the reason why
+    std::vector< std::pair<std::string, std::string> > skipped() {
+        std::lock_guard<std::mutex> lock( mutex );
+        return skips;
+    }
+
+    size_t size() const {
+        return found;
+    }
+
+private:
+
+    struct task {
+        std::string path;
+        bool is_dir;
+    };
+
+    bool over() const {
+        return closed && pending.empty() && busy == 0;
+    }
+
+    void emit( const std::string &pathfile, std::uint64_t size, std::uint64_t mtime ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        files.push_back( file { pathfile, size, mtime } );
+        found++;
+        ready.notify_one();
+    }
+
+    void skip( const std::string &pathfile, const std::string &reason ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        skips.push_back( std::make_pair( pathfile, reason ) );
+    }
+
+    void folder( const std::string &dir ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        pending.push_back( task { dir, true } );
+        wakeup.notify_one();
+    }
+
+    void list( const std::string &dir ) {
+        auto start = now();
+        const std::string base = dir.empty() || dir.back() == '/' || dir.back() == '\\' ? dir : dir + "/";
+#ifdef _WIN32
+        WIN32_FIND_DATAA fd;
+        HANDLE h = FindFirstFileA( ( base + "*" ).c_str(), &fd );
+        if( h != INVALID_HANDLE_VALUE ) {
+            do {
+                std::string name = fd.cFileName;
+                if( name == "." || name == ".." ) {
+                    continue;
+                }
+                // reparse points (symlinks, junctions) to directories are not followed, so the walk cannot loop
+                if( ( fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) && ( fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT ) ) {
+                    skip( base + name, "link to a directory, not followed" );
+                } else if( fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) {
+                    if( recursive ) folder( base + name );
+                } else if( !( fd.dwFileAttributes & FILE_ATTRIBUTE_DEVICE ) ) {
+                    // FILETIME counts 100ns ticks since 1601
+                    std::uint64_t ticks = ( std::uint64_t( fd.ftLastWriteTime.dwHighDateTime ) << 32 ) | fd.ftLastWriteTime.dwLowDateTime;
+                    std::uint64_t mtime = ticks > 116444736000000000ULL ? ( ticks - 116444736000000000ULL ) / 10000000 : 0;
+                    emit( base + name, ( std::uint64_t( fd.nFileSizeHigh ) << 32 ) | fd.nFileSizeLow, mtime );
+                }
+            } while( FindNextFileA( h, &fd ) );
+            FindClose( h );
+        }
+#else
+        if( DIR *d = opendir( dir.c_str() ) ) {
+            while( struct dirent *e = readdir( d ) ) {
+                std::string name = e->d_name;
+                if( name == "." || name == ".." ) {
+                    continue;
+                }
+#ifdef DT_DIR
+                if( e->d_type == DT_DIR ) {
+                    if( recursive ) folder( base + name );
+                    continue;
+                }
+#endif
+                visit( base + name );
+            }
+            closedir( d );
+        }
+#endif
+        stages.add( profiler::SCAN, start );
+    }
+
+#ifndef _WIN32
+    // classifies a directory entry with a single stat for regular files. symlinked directories are not followed,
+    // so the walk cannot loop; they, dangling symlinks and special files are skipped, since none can be read as a file.
+    void visit( const std::string &pathfile ) {
+        struct stat st;
+        if( 0 != lstat( pathfile.c_str(), &st ) ) {
+            skip( pathfile, "cannot stat" );
+            return;
+        }
+        if( S_ISLNK( st.st_mode ) ) {
+            if( 0 != stat( pathfile.c_str(), &st ) ) {
+                skip( pathfile, "dangling symlink" );
+                return;
+            }
+            if( S_ISDIR( st.st_mode ) ) {
+                skip( pathfile, "symlink to a directory, not followed" );
+                return;
+            }
+        } else if( S_ISDIR( st.st_mode ) ) {
+            if( recursive ) folder( pathfile );
+            return;
+        }
+        if( S_ISREG( st.st_mode ) ) {
+            emit( pathfile, std::uint64_t( st.st_size ), std::uint64_t( st.st_mtime ) );
+        } else {
+            skip( pathfile, "not a regular file" );
+        }
+    }
+#endif
+
+    void run() {
+        for(;;) {
+            task t;
+            {
+                std::unique_lock<std::mutex> lock( mutex );
+                wakeup.wait( lock, [&]{ return !pending.empty() || over(); } );
+                if( pending.empty() ) {
+                    return;
+                }
+                t = pending.front();
+                pending.pop_front();
+                busy++;
+            }
+
+            if( t.is_dir ) {
+                list( t.path );
+            } else if( t.path.find_first_of("*?") != std::string::npos ) {
+                // masks are resolved by sao, as they always were
+                auto start = now();
+                sao::folder matched;
+                matched.include( t.path, {"*"}, recursive );
+                stages.add( profiler::SCAN, start );
+                for( auto &match : matched ) {
+                    struct stat st;
+                    if( match.is_dir() || 0 != stat( match.name().c_str(), &st ) ) {
+                        continue;
+                    }
+                    if( S_ISREG( st.st_mode ) ) {
+                        emit( match.name(), std::uint64_t( st.st_size ), std::uint64_t( st.st_mtime ) );
+                    } else if( !S_ISDIR( st.st_mode ) ) {
+                        skip( match.name(), "not a regular file" );
+                    }
+                }
+            } else {
+                // paths given explicitly are followed, even when symlinked
+                struct stat st;
+                if( 0 == stat( t.path.c_str(), &st ) ) {
+                    if( S_ISDIR( st.st_mode ) ) {
+                        list( t.path );
+                    } else if( S_ISREG( st.st_mode ) ) {
+                        emit( t.path, std::uint64_t( st.st_size ), std::uint64_t( st.st_mtime ) );
+                    } else {
+                        skip( t.path, "not a regular file" );
+                    }
+                }
+            }
+
+            std::lock_guard<std::mutex> lock( mutex );
+            busy--;
+            if( over() ) {
+                wakeup.notify_all();
+                ready.notify_all();
+            }
+        }
+    }
+
+    const bool recursive;
+    std::vector< std::thread > threads;
+    std::mutex mutex;
+    std::condition_variable wakeup, ready;
+    std::deque<task> pending;
+    std::deque<file> files;
+    std::vector< std::pair<std::string, std::string> > skips;
+    unsigned busy;
+    bool closed;
+    std::atomic<size_t> found;
+};
+
+// same results as bundle::measures(), but packed and unpacked data go to the buffers of given arena
+std::vector<bundle::measure> &measure( const std::string &input, const std::vector<unsigned> &encoders, arena &buf ) {
+    buf.measures.resize( encoders.size() );
+    for( size_t i = 0; i < encoders.size(); ++i ) {
+        auto &m = buf.measures[i];
+        m.q = encoders[i];
+        m.ratio = m.enctime = m.dectime = m.memusage = 0;
+
+        auto start = now();
+        m.pass = bundle::pack( m.q, m.packed, input );
+        m.enctime = double( std::chrono::duration_cast< std::chrono::microseconds >( now() - start ).count() );
+
+        start = now();
+        m.pass = m.pass && bundle::unpack( buf.unpacked, m.packed ) && buf.unpacked == input;
+        m.dectime = double( std::chrono::duration_cast< std::chrono::microseconds >( now() - start ).count() );
+
+        m.ratio = input.size() ? 100 - 100 * double( m.packed.size() ) / input.size() : 0;
+    }
+    return buf.measures;
+}
+
+// fixed pool of workers. each worker owns a job queue; idle workers steal from the back of their siblings' queues.
+// every job declares an estimated memory cost, and a worker only starts a job when it fits in the memory budget.
+// jobs larger than the whole budget are run alone.
+struct workpool {
+    typedef std::function<void( unsigned worker_id )> job;
+
+    struct task {
+        job fn;
+        std::uint64_t cost;
+        std::chrono::steady_clock::time_point pushed;
+    };
+
+    struct worker {
+        std::mutex mutex;
+        std::deque<task> jobs;
+        unsigned done = 0, stolen = 0;
+        double busy = 0;
+    };
+
+    explicit
+    workpool( unsigned num_workers, std::uint64_t budget = 0 ) : queued(0), pending(0), quit(false), next(0), started(now()),
+        budget(budget), used(0), peak(0) {
+        num_workers = num_workers ? num_workers : 1;
+        for( unsigned i = 0; i < num_workers; ++i ) {
+            workers.emplace_back( new worker );
+        }
+        for( unsigned i = 0; i < num_workers; ++i ) {
+            threads.emplace_back( [this,i]() { run(i); } );
+        }
+    }
+
+    ~workpool() {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            quit = true;
+        }
+        wakeup.notify_all();
+        for( auto &in : threads ) {
+            if( in.joinable() ) {
+                in.join();
+            }
+        }
+    }
+
+    // jobs may push jobs. a job is counted before any worker can see it, so a sibling that steals it right away
+    // cannot take `queued` below zero, nor let wait() return while it is still to run.
+    void push( const job &fn, std::uint64_t cost = 0 ) {
+        auto &w = *workers[ next++ % workers.size() ];
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            ++queued;
+            ++pending;
+            std::lock_guard<std::mutex> enqueue( w.mutex );
+            w.jobs.push_back( task { fn, cost, now() } );
+        }
+        wakeup.notify_one();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock( mutex );
+        idle.wait( lock, [&]{ return pending == 0; } );
+    }
+
+    unsigned size() const {
+        return unsigned( workers.size() );
+    }
+
+    std::uint64_t peak_memory() const {
+        return peak;
+    }
+
+    std::string report() const {
+        double elapsed = std::chrono::duration_cast< std::chrono::microseconds >( now() - started ).count() / 1000000.0;
+        std::stringstream cout;
+        for( unsigned i = 0; i < workers.size(); ++i ) {
+            auto &w = *workers[i];
+            cout << "worker #" << i << ": " << w.done << " jobs (" << w.stolen << " stolen), " << w.busy << " secs busy (" << ( elapsed > 0 ? 100 * w.busy / elapsed : 0 ) << "%)" << std::endl;
+        }
+        if( budget ) {
+            cout << "memory: " << ( peak / 1024 / 1024 ) << " MiB estimated peak, " << ( budget / 1024 / 1024 ) << " MiB budget" << std::endl;
+        }
+        return cout.str();
+    }
+
+private:
+
+    bool pop( unsigned id, task &t ) {
+        // own queue first (fifo), then steal from the tail of the siblings
+        for( unsigned i = 0, end = unsigned( workers.size() ); i < end; ++i ) {
+            auto &w = *workers[ (id + i) % end ];
+            std::lock_guard<std::mutex> lock( w.mutex );
+            if( w.jobs.empty() ) {
+                continue;
+            }
+            if( i == 0 ) {
+                t = std::move( w.jobs.front() );
+                w.jobs.pop_front();
+            } else {
+                t = std::move( w.jobs.back() );
+                w.jobs.pop_back();
+                workers[id]->stolen++;
+            }
+            --queued;
+            return true;
+        }
+        return false;
+    }
+
+    bool fits( std::uint64_t cost ) const {
+        return !budget || used == 0 || used + cost <= budget;
+    }
+
+    void admit( std::uint64_t cost ) {
+        used += cost;
+        peak = used > peak ? used : peak;
+    }
+
+    // a job that does not fit in the memory left is parked, rather than holding the worker that popped it. nothing else
+    // is admitted while a job is parked, so jobs larger than the whole budget are not overtaken until the queues drain.
+    void run( unsigned id ) {
+        auto &self = *workers[id];
+        for(;;) {
+            task t;
+            {
+                std::unique_lock<std::mutex> lock( mutex );
+                wakeup.wait( lock, [&]{ return quit || ( parked ? fits( waiting.cost ) : queued > 0 ); } );
+                if( quit ) {
+                    return;
+                }
+                if( parked ) {
+                    t = std::move( waiting );
+                    parked = false;
+                    admit( t.cost );
+                }
+            }
+
+            if( !t.fn ) {
+                if( !pop( id, t ) ) {
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock( mutex );
+                if( parked ) {
+                    // another job was parked meanwhile: this one goes back in line
+                    ++queued;
+                    std::lock_guard<std::mutex> back( self.mutex );
+                    self.jobs.push_front( std::move( t ) );
+                    continue;
+                }
+                if( !fits( t.cost ) ) {
+                    waiting = std::move( t );
+                    parked = true;
+                    continue;
+                }
+                admit( t.cost );
+            }
+
+            stages.add( profiler::QUEUE, t.pushed );
+
+            auto start = now();
+            t.fn( id );
+            self.busy += std::chrono::duration_cast< std::chrono::microseconds >( now() - start ).count() / 1000000.0;
+            self.done++;
+
+            std::lock_guard<std::mutex> lock( mutex );
+            used -= t.cost;
+            if( parked ) {
+                wakeup.notify_all();
+            }
+            if( 0 == --pending ) {
+                idle.notify_all();
+            }
+        }
+    }
+
+    std::vector< std::unique_ptr<worker> > workers;
+    std::vector< std::thread > threads;
+    std::mutex mutex;
+    std::condition_variable wakeup, idle;
+    std::atomic<size_t> queued;
+    size_t pending;
+    bool quit;
+    task waiting;
+    bool parked = false;
+    std::atomic<unsigned> next;
+    std::chrono::steady_clock::time_point started;
+    std::uint64_t budget, used, peak;
+};
+
+int main( int argc, const char **argv ) {
+    struct getopt args( argc, argv );
+
+    if( args.has("-?") || args.has("-h") || args.has("--help") || args.size() <= 3 ) {
+        std::cout << head(args[0]) << std::endl;
+        std::cout << help(args[0]);
+
+        bubble::show( bubble::string() <<
+            "title.text=About;"
+            "body.icon=8;" //8
+            "head.text=" << BUNDLER_TEXT << ";"
+            "body.text=" << "<a href\a\"" << BUNDLER_URL << "\">" << BUNDLER_URL << "</a>;"
+            "style.minimizable=1;"
+        );
+
+        return 0;
+    }
+
+    const bool moveit = args[1] == "m" || args[1] == "move";
+    const bool packit = args[1] == "p" || args[1] == "pack" || args[1] == "a" || args[1] == "add";
+    const bool updtit = args[1] == "u" || args[1] == "update";
+    const bool testit = args[1] == "t" || args[1] == "test";
+    const bool vrfyit = args[1] == "v" || args[1] == "verify";
+    const bool upckit = args[1] == "x" || args[1] == "extract";
+    const bool listit = args[1] == "l" || args[1] == "list";
+    const bool benchit = args[1] == "b" || args[1] == "bench";
+
+    std::vector<unsigned> encoders, fast_encoders;
+    const std::string archive = args[2];
+    unsigned max_threads = 8;
+
+    const bool flat = args.has("-f") || args.has("--flat");
+    const bool quiet = args.has("-q") || args.has("--quiet");
+    const bool recursive = args.has("-r") || args.has("--recursive");
+    const bool use = args.has("-u") || args.has("--use");
+    const bool verbose = ( args.has("-v") || args.has("--verbose") ) && !quiet;
+    const bool rehash = args.has("-H") || args.has("--hash");
+    const bool filtering = !( args.has("-F") || args.has("--no-filters") );
+    stages.tracing = args.has("-T") || args.has("--trace");
+    const bool tostdout = upckit && ( args.has("-o") || args.has("--stdout") );
+    bool from_stdin = false;    // pack standard input as an entry named "stdin"
+    double treshold = 95.00;    // ignore compression settings if compression ratio below of given treshold 
+    size_t lte = 0;             // bypass slow encoders on files larger or equal than given size (in KiB)
+    unsigned predicted = 0;     // only measure the N encoders predicted to pack best (0 = measure all of them)
+    std::string cachefile;      // learned encoder decisions, if any
+    std::string tracefile;      // chrome://tracing file of every timed stage, if any
+    std::string progress;       // format of the periodic status line (text or json), if any
+    std::uint64_t solid = 0;    // pack files smaller than a quarter of given size together, in solid blocks of given size (in bytes)
+    std::uint64_t chunk = 0;    // pack files larger than given size in independent chunks of given size (in bytes)
+    std::uint64_t dictsize = 0; // pack files smaller than given size with a dictionary trained from them (in bytes)
+    std::uint64_t memlimit = physical_memory() / 2; // estimated memory that concurrent jobs may use (in bytes, 0 = unlimited)
+    pacer pace;                 // throughput target or deadline that encoder choices keep pace with, if any
+    unsigned repeats = 3, warmups = 1; // measured and unmeasured runs per encoder and thread count, when benchmarking
+
+    // extracted data owns stdout when streaming, so every message goes to stderr instead
+    std::ostream stdout_stream( std::cout.rdbuf() );
+    if( tostdout ) {
+#ifdef _WIN32
+        _setmode( _fileno( stdout ), _O_BINARY );
+#endif
+        std::cout.rdbuf( std::cerr.rdbuf() );
+    }
+
+    if( !quiet ) {
+        std::cout << head(args[0]) << std::endl;
+    }
+
+    if( verbose ) {
+        std::cout << "options: ";
+        std::cout << "moveit=" << moveit << ',';
+        std::cout << "packit=" << packit << ',';
+        std::cout << "updtit=" << updtit << ',';
+        std::cout << "testit=" << testit << ',';
+        std::cout << "vrfyit=" << vrfyit << ',';
+        std::cout << "xtrcit=" << upckit << ',';
+        std::cout << "archive=" << archive << ',';
+        std::cout << "flat=" << flat << ',';
+        std::cout << "quiet=" << quiet << ',';
+        std::cout << "recursive=" << recursive << ',';
+        std::cout << "use=" << use << ',';
+        std::cout << "verbose=" << verbose << ',';
+        std::cout << "treshold=" << treshold << ',';
+        std::cout << "lte=" << lte;
+        /*
+        std::cout << "args=";
+        for( auto &arg : args ) {
+            std::cout << arg.first << ' ';
+        }
+        */
+        std::cout << std::endl;
+    }
+
+    std::atomic<int> numerrors( 0 ); // also counted by workers, without the lock
+    int processed = 0;
+    std::uint64_t total_input = 0, total_output = 0;
+    std::uint64_t duplicates = 0, deduped = 0;
+    std::uint64_t bypassed = 0, bypassed_bytes = 0; // inputs stored raw by the entropy probe
+
+    if( !moveit && !packit && !updtit && !testit && !vrfyit && !upckit && !listit && !benchit ) {
+        std::cout << help(args[0]);
+        std::cout << "No command." << std::endl;
+        return -1;
+    }
+
+    bundle::archive archived;
+    std::vector<std::string> to_pack; // paths to walk: files, directories or masks
+    std::vector<std::string> masks, excludes; // extract, test, verify and list only
+
+    for( int i = 3; args.has(i); ++i ) {
+        if( args[i] == "-F" || args[i] == "--no-filters" ||
+            args[i] == "-f" || args[i] == "--flat" ||
+            args[i] == "-o" || args[i] == "--stdout" ||
+            args[i] == "-q" || args[i] == "--quiet" ||
+            args[i] == "-r" || args[i] == "--recursive" ||
+            args[i] == "-v" || args[i] == "--verbose" ) {
+            continue;
+        }
+        if( args[i] == "-P" || args[i] == "--progress" ) {
+            if( args.has(++i) ) {
+                progress = args[i];
+            }
+            continue;
+        }
+        if( args[i] == "-T" || args[i] == "--trace" ) {
+            if( args.has(++i) ) {
+                tracefile = args[i];
+            }
+            continue;
+        }
+        if( args[i] == "-t" || args[i] == "--threads" ) {
+            if( args.has(++i) ) {
+                max_threads = args[i].as<unsigned>();
+            }
+            continue;
+        }        
+        if( args[i] == "-e" || args[i] == "--exclude" ) {
+            if( args.has(++i) ) {
+                excludes.push_back( args[i] );
+            }
+            continue;
+        }
+        if( args[i] == "-i" || args[i] == "--ignore" ) {
+            if( args.has(++i) ) {
+                treshold = args[i].as<double>();
+            }
+            continue;
+        }        
+        if( args[i] == "-b" || args[i] == "--bypass-slow" ) {
+            if( args.has(++i) ) {
+                lte = args[i].as<unsigned>(); 
+            }
+            continue;
+        }        
+        if( args[i] == "-D" || args[i] == "--dictionary" ) {
+            if( args.has(++i) ) {
+                dictsize = args[i].as<std::uint64_t>() * 1024;
+            }
+            continue;
+        }
+        if( args[i] == "-k" || args[i] == "--chunk" ) {
+            if( args.has(++i) ) {
+                chunk = args[i].as<std::uint64_t>() * 1024;
+            }
+            continue;
+        }
+        if( args[i] == "-m" || args[i] == "--memory-limit" ) {
+            if( args.has(++i) ) {
+                memlimit = args[i].as<std::uint64_t>() * 1024 * 1024;
+            }
+            continue;
+        }
+        if( args[i] == "-n" || args[i] == "--repeat" ) {
+            if( args.has(++i) ) {
+                repeats = args[i].as<unsigned>();
+            }
+            continue;
+        }
+        if( args[i] == "-p" || args[i] == "--predict" ) {
+            if( args.has(++i) ) {
+                predicted = args[i].as<unsigned>();
+            }
+            continue;
+        }
+        if( args[i] == "-l" || args[i] == "--deadline" ) {
+            if( args.has(++i) ) {
+                pace.deadline = args[i].as<double>();
+            }
+            continue;
+        }
+        if( args[i] == "-R" || args[i] == "--throughput" ) {
+            if( args.has(++i) ) {
+                pace.throughput = args[i].as<double>() * 1024 * 1024;
+            }
+            continue;
+        }
+        if( args[i] == "-s" || args[i] == "--solid" ) {
+            if( args.has(++i) ) {
+                solid = args[i].as<std::uint64_t>() * 1024;
+            }
+            continue;
+        }
+        if( args[i] == "-w" || args[i] == "--warmup" ) {
+            if( args.has(++i) ) {
+                warmups = args[i].as<unsigned>();
+            }
+            continue;
+        }
+        if( args[i] == "-u" || args[i] == "--use" ) {
+            if( args.has(++i) ) {
                 /**/ if( args[i].lowercase() == "bcm" )       encoders.push_back( bundle::BCM );
                 else if( args[i].lowercase() == "brotli11" )  encoders.push_back( bundle::BROTLI11 );
                 else if( args[i].lowercase() == "brotli9" )   encoders.push_back( bundle::BROTLI9 );
@@ -317,6 +2402,12 @@ int main( int argc, const char **argv ) {
             }
             continue;
         }
+        if( args[i] == "-c" || args[i] == "--cache" ) {
+            if( args.has(++i) ) {
+                cachefile = args[i];
+            }
+            continue;
+        }
         if( args[i] == "-d" || args[i] == "--delete" ) {
             auto erase = [&]( int Q ) {
                 encoders.erase( std::remove( encoders.begin(), encoders.end(), Q ), encoders.end() );
@@ -353,316 +2444,1507 @@ int main( int argc, const char **argv ) {
             continue;
         }
 
-        if( args[i][0] == '@' ) {
-            // is it a @list.txt kind of file ?
-            std::ifstream ifs( &args[i][1] );
-            if( ifs.good() ) {
-                std::stringstream ss; 
-                if( ss << ifs.rdbuf() ) {
-                    auto lines = wire::string( ss.str() ).tokenize("\t\f\v\r\n");
-                    for( auto end = lines.size(), it = end - end; it < end; ++it ) {
-                        to_pack.include( lines[it], {"*"}, recursive );
+        if( args[i] == "-" && ( packit || moveit || updtit ) ) {
+            from_stdin = true;
+            continue;
+        }
+
+        if( args[i][0] == '@' ) {
+            // is it a @list.txt kind of file ?
+            std::ifstream ifs( &args[i][1] );
+            if( ifs.good() ) {
+                std::stringstream ss; 
+                if( ss << ifs.rdbuf() ) {
+                    auto lines = wire::string( ss.str() ).tokenize("\t\f\v\r\n");
+                    for( auto end = lines.size(), it = end - end; it < end; ++it ) {
+                        if( packit || moveit || updtit || benchit ) {
+                            to_pack.push_back( lines[it] );
+                        } else {
+                            masks.push_back( lines[it] );
+                        }
+                    }
+                }
+            }
+        } else {
+            // regular file or mask
+            if( packit || moveit || updtit || benchit ) {
+                to_pack.push_back( args[i] );
+            } else {
+                masks.push_back( args[i] );
+            }
+        }
+    }
+
+    if( encoders.empty() ) {
+        encoders.push_back( bundle::LZMA20 );
+    }
+
+    if( fast_encoders.empty() ) {
+        fast_encoders.push_back( bundle::LZMA20 );
+    }
+
+    if( (packit || moveit || updtit || benchit) && to_pack.empty() && !from_stdin ) {
+        std::cout << help(args[0]);
+        std::cout << "No files provided." << std::endl;
+        return -1;
+    }
+
+    // progress is updated by workers and read by the window and console threads: counters are atomics, texts are guarded
+    std::atomic<int> progress_pct( 0 ), progress_idx( 0 ), appexit( 0 );
+    std::atomic<std::uint64_t> done_bytes( 0 ), done_output( 0 ), expected_bytes( 0 );
+    guarded title_mode, title_name;
+
+    // messages are queued to the console thread, which also reports throughput and eta when requested
+    console screen;
+    if( !progress.empty() ) {
+        const bool json = progress == "json";
+        screen.status = [&, json]() -> std::string {
+            double secs = taken(), rate = secs > 0 ? done_bytes / secs : 0;
+            std::uint64_t left = expected_bytes > done_bytes ? expected_bytes - done_bytes : 0;
+            double eta = rate > 0 ? left / rate : 0;
+            std::uint64_t in = done_bytes, out = done_output;
+            std::stringstream ss;
+            if( json ) {
+                ss << "{\"elapsed\":" << secs << ",\"files\":" << progress_idx << ",\"percent\":" << (std::min)( progress_pct.load(), 100 )
+                   << ",\"bytes\":" << in << ",\"expected\":" << expected_bytes << ",\"output\":" << out << ",\"ratio\":" << ratio( in, out )
+                   << ",\"rate\":" << rate << ",\"eta\":" << eta << "}";
+            } else {
+                ss << "[" << std::setw(3) << (std::min)( progress_pct.load(), 100 ) << "%] " << progress_idx << " files, " << ( in >> 20 ) << "/" << ( expected_bytes >> 20 )
+                   << " MiB -> " << ( out >> 20 ) << " MiB (" << ratio( in, out ) << "%) in " << secs << " secs (" << rate / ( 1 << 20 ) << " MiB/s), eta " << eta << " secs";
+            }
+            return ss.str();
+        };
+        screen.interval = 1;
+    }
+    screen.start();
+
+    std::thread bubble( [&]() {
+        if( !quiet )
+        bubble::show( bubble::string() <<
+            "title.text=" << BUNDLER_TEXT ";"
+            "body.icon=8;"
+            "head.text=;"
+            "body.text=;"
+            "style.minimizable=1;"
+//          "style.minimized=1;"
+            "progress=0;",
+            [&]( bubble::vars &vars ) {
+                int pct = progress_pct;
+                vars["head.text"] = title_mode.str();
+                vars["title.text"] = std::string() + BUNDLER_TEXT " - " + std::to_string( pct > 100 ? 100 : pct ) + "%";
+                vars["progress"] = pct;
+                vars["body.text"] = title_name.str();
+                if( appexit ) vars["exit"] = 0;
+            }
+        );
+    } ) ;
+
+    auto readfile = [&]( const std::string &pathfile, std::string &out ) -> bool {
+        bool ok = readinto( pathfile, out );
+        if( !ok ) {
+            screen.err() << "[FAIL] " << pathfile << ": cannot read file" << std::endl;
+            numerrors ++;
+            out.clear();
+        }
+        return ok;
+    };
+
+    auto flatten = []( const std::string &pathfile ) -> std::string {
+        unsigned a = pathfile.find_last_of('/'); a = ( a == std::string::npos ? 0 : a + 1 );
+        unsigned b = pathfile.find_last_of('\\'); b = ( b == std::string::npos ? 0 : b + 1 );
+        return pathfile.substr( a > b ? a : b );
+    };
+
+    auto normalize = []( std::string pathfile ) -> std::string {
+        for( auto &p : pathfile ) {
+            if( p == '\\' ) p = '/';
+            if( p == ':' ) p = '/';
+        }
+        return pathfile.size() && pathfile[0] == '/' ? pathfile.substr(1) : pathfile;
+    };
+
+    // app starts here
+
+    progress_idx = 0;
+
+    if( moveit || packit || updtit ) {
+
+        std::string algorithms;
+        for( auto &u : encoders ) { algorithms += std::string( bundle::name_of(u) ) + ","; }
+        if( algorithms.size() ) algorithms.pop_back();
+        const std::string mode = packit ? "pack" : ( moveit ? "move" : "update" );
+        title_mode = mode + " (" + algorithms + ")";
+
+        // when updating, previous entries are indexed by name. entries whose file was not found are kept as they are,
+        // once the walk is over.
+        bundle::archive previous;
+        bndreader reader;
+        std::map<std::string, size_t> unchanged_candidates;
+        std::map<std::string, bool> given;
+        if( updtit && reader.open( archive, previous ) ) {
+            for( size_t i = 0; i < previous.size(); ++i ) {
+                unchanged_candidates[ previous[i]["name"] ] = i;
+            }
+        }
+
+        // entries are appended as files are found, while workers fill the earlier ones in. a deque keeps references
+        // to its elements valid as it grows; they are moved to the archive once every job is done.
+        std::deque<bundle::file> listing;
+        std::mutex listing_mutex;
+        auto entry = [&]( int idx ) -> bundle::file & {
+            std::lock_guard<std::mutex> lock( listing_mutex );
+            return listing[ size_t( idx ) ];
+        };
+        auto append = [&]() -> int {
+            std::lock_guard<std::mutex> lock( listing_mutex );
+            listing.push_back( bundle::file() );
+            return processed++;
+        };
+        std::atomic<size_t> entries( 1 ); // progress is reported over the entries found so far
+
+        learncache cache;
+        if( !cachefile.empty() ) {
+            cache.load( cachefile );
+        }
+
+        // payloads go to a temporary file, which replaces the archive once everything has been packed
+        const std::string tmpfile = archive + ".tmp";
+        bndwriter writer;
+        if( !writer.open( tmpfile ) ) {
+            screen.err() << "[FAIL] " << tmpfile << ": cannot write to disk" << std::endl;
+            numerrors ++;
+        }
+
+        // every job is admitted against the memory budget: input, candidate outputs and the largest encoder working set
+        auto cost_of = [&]( std::uint64_t len ) -> std::uint64_t {
+            std::uint64_t outputs = 0, largest = 0;
+            for( auto &q : encoders ) {
+                outputs += bundle::bound( q, len );
+                largest = (std::max)( largest, workingset( q, len ) );
+            }
+            return len + outputs + largest;
+        };
+        workpool pool( max_threads, memlimit );
+        std::vector<arena> arenas( pool.size() );
+        pace.workers = pool.size();
+
+        static std::mutex mutex;
+
+        // identical contents are stored once: later copies become links that share the payload of the first one.
+        // links are resolved once every payload has been written.
+        std::mutex dedup_mutex;
+        std::map< std::tuple<std::uint64_t, std::uint32_t, std::uint64_t>, std::pair<int, std::string> > contents; // (hash,sum,len) -> owner entry, file
+        std::map< std::string, int > copied;                                // previous payload -> owner entry, when updating
+        std::vector< std::pair<int, int> > links;                           // (entry, owner entry)
+        std::map< std::string, std::string > dicts;                         // previous dictionary -> copied dictionary, when updating
+
+        // copies a previous payload verbatim, without decoding it
+        auto reuse = [&]( int idx, size_t old ) -> bool {
+            auto &with = entry( idx );
+            {
+                std::lock_guard<std::mutex> lock( dedup_mutex );
+                std::string key = previous[old].count("offset") ? previous[old]["offset"] + "+" + previous[old]["size"] : "#" + std::to_string( old );
+                auto found = copied.find( key );
+                if( found != copied.end() ) {
+                    with = previous[old];
+                    with.erase( "data" );
+                    links.push_back( std::make_pair( idx, found->second ) );
+
+                    std::lock_guard<std::mutex> lock( mutex );
+                    total_input += field_of( with, "len" );
+                    pace.done += field_of( with, "len" );
+                    done_bytes += field_of( with, "len" );
+                    return true;
+                }
+                copied[ key ] = idx;
+            }
+            std::string payload;
+            std::uint64_t offset = 0;
+            bool ok = true;
+            with = previous[old];
+            with.erase( "data" );
+            with.erase( "link" ); // this entry owns its copy now; the link pass sets it again for real links only
+            if( !with.count("encoder") && reader.encoder( previous[old] ).size() ) {
+                with["encoder"] = reader.encoder( previous[old] ); // legacy archives tell packed payloads apart by their header
+            }
+            if( with.count("chunks") ) {
+                // copy every chunk, then point the chunk list to the new offsets
+                std::string chunks, sep;
+                std::uint64_t packed = 0;
+                for( auto &part : wire::string( with["chunks"] ).tokenize(",") ) {
+                    wire::strings fields = part.tokenize(":");
+                    ok = ok && fields.size() >= 3 && reader.payload( fields[0].as<std::uint64_t>(), fields[1].as<std::uint64_t>(), payload ) && writer.append( payload, offset );
+                    if( fields.size() < 3 ) {
+                        continue;
+                    }
+                    chunks += sep + std::to_string( offset ) + ":" + fields[1] + ":" + fields[2] + ":" + ( fields.size() > 3 ? fields[3] : std::to_string( crc32c( payload ) ) );
+                    for( size_t f = 4; f < fields.size(); ++f ) {
+                        chunks += ":" + fields[f];
+                    }
+                    packed += payload.size();
+                    sep = ",";
+                }
+                with["chunks"] = chunks;
+                payload.resize( size_t( packed ) );
+            } else {
+                ok = reader.payload( previous[old], payload ) && writer.append( payload, offset );
+                with["offset"] = std::to_string( offset );
+                with["size"] = std::to_string( payload.size() );
+                if( !with.count("crc") ) {
+                    with["crc"] = std::to_string( crc32c( payload ) );
+                }
+            }
+            if( with.count("dict") ) {
+                // dictionaries are shared: each one is copied once, along with its first entry
+                std::lock_guard<std::mutex> lock( dedup_mutex );
+                auto found = dicts.find( with["dict"] );
+                if( found == dicts.end() ) {
+                    wire::strings fields = wire::string( with["dict"] ).tokenize(":");
+                    std::string saved;
+                    std::uint64_t at = 0;
+                    bool copied = fields.size() == 2 && reader.payload( fields[0].as<std::uint64_t>(), fields[1].as<std::uint64_t>(), saved ) && writer.append( saved, at );
+                    ok = ok && copied;
+                    found = dicts.insert( std::make_pair( with["dict"], std::to_string( at ) + ":" + std::to_string( saved.size() ) ) ).first;
+                }
+                with["dict"] = found->second;
+            }
+
+            mutex.lock();
+            if( !ok ) {
+                screen.err() << "[FAIL] " << with["name"] << ": cannot copy previous entry" << std::endl;
+                numerrors ++;
+            }
+            std::uint64_t len = field_of( with, "len", payload.size() );
+            total_input += len;
+            total_output += payload.size();
+            done_output += payload.size();
+            pace.done += len;
+            done_bytes += len;
+            mutex.unlock();
+            return ok;
+        };
+
+        // an entry is unchanged if its size and date match (and its contents hash, if requested). unchanged entries are reused.
+        auto unchanged = [&]( int idx, const std::string &filename, const std::string &name, std::uint64_t len, std::uint64_t mtime ) -> bool {
+            auto found = unchanged_candidates.find( name );
+            if( found == unchanged_candidates.end() ) {
+                return false;
+            }
+            auto &old = previous[ found->second ];
+            bool same = old.count("len") && old.count("mtime") && old["len"] == std::to_string( len ) && old["mtime"] == std::to_string( mtime );
+            if( same && rehash ) {
+                std::string data;
+                std::uint64_t chunked = field_of( old, "chunk" );
+                same = old.count("hash") && readinto( filename, data ) && old["hash"] == std::to_string( hash64( data, chunked ) );
+            }
+            if( !same ) {
+                return false;
+            }
+
+            bool ok = reuse( idx, found->second );
+            mutex.lock();
+            progress_pct = (++progress_idx * 100) / entries;
+            title_name = filename;
+            if( !quiet && ok ) {
+                screen.out() << "[ OK ] " << filename << ": unchanged" << std::endl;
+            }
+            mutex.unlock();
+            return true;
+        };
+
+        // links entry to an entry packed earlier in this run with identical contents, if any. neither hash is
+        // cryptographic, so matching hashes and size only nominate the owner: the bytes of both files are compared
+        // before linking, and a collision is packed as a file of its own.
+        auto duplicate = [&]( int idx, const std::string &filename, const std::string &input, std::uint64_t hash, std::uint32_t sum ) -> bool {
+            std::pair<int, std::string> owner;
+            {
+                std::lock_guard<std::mutex> lock( dedup_mutex );
+                auto key = std::make_tuple( hash, sum, std::uint64_t( input.size() ) );
+                auto found = contents.find( key );
+                if( found == contents.end() ) {
+                    contents[ key ] = std::make_pair( idx, filename );
+                    return false;
+                }
+                owner = found->second;
+            }
+
+            const std::uint64_t block = 1024 * 1024;
+            std::string theirs;
+            for( std::uint64_t at = 0; at < input.size(); at += block ) {
+                bool same = readinto( owner.second, theirs, at, block ) && theirs.size() == (std::min)( block, input.size() - at );
+                if( !same || 0 != input.compare( size_t( at ), theirs.size(), theirs ) ) {
+                    return false;
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock( dedup_mutex );
+                links.push_back( std::make_pair( idx, owner.first ) );
+            }
+
+            mutex.lock();
+            progress_pct = (++progress_idx * 100) / entries;
+            title_name = filename;
+            duplicates++;
+            deduped += input.size();
+            total_input += input.size();
+            pace.done += input.size();
+            done_bytes += input.size();
+            if( !quiet ) {
+                screen.out() << "[ OK ] " << filename << ": " << input.size() << " -> 0 (duplicate)" << std::endl;
+            }
+            mutex.unlock();
+            return true;
+        };
+
+        // packs input with the best encoder, appends payload to the archive and reports it.
+        // payload location and encoder are stored into `with`.
+        auto store = [&]( bundle::file &with, const std::string &input, std::uint64_t len, const std::string &label, const std::string &ext, int files, arena &buf ) {
+            std::map<unsigned, double> estimates;
+            std::vector<unsigned> candidates = lte && input.size() >= lte * 1024 ? fast_encoders : encoders;
+
+            // already compressed inputs are stored as they are, without trying any encoder
+            bool raw = false;
+            if( treshold < 100 && candidates.size() ) {
+                auto start = now();
+                raw = incompressible( input );
+                stages.add( profiler::PROBE, start, input.size() );
+                if( raw ) {
+                    candidates.clear();
+                }
+            }
+
+            if( !cachefile.empty() && !raw ) {
+                candidates = cache.shortlist( ext, candidates );
+            }
+            candidates = pace.plan( candidates, input.size(), taken() );
+
+            // encoders see the filtered input, when a filter helps the first candidate
+            filter how;
+            if( filtering && candidates.size() ) {
+                auto start = now();
+                how = filter::pick( input, candidates[0], buf );
+                if( how.kind != filter::NONE ) {
+                    how.apply( input, buf.filtered );
+                }
+                stages.add( profiler::FILTER, start, input.size() );
+            }
+            const std::string &data = how.kind != filter::NONE ? buf.filtered : input;
+
+            if( predicted && candidates.size() ) {
+                auto start = now();
+                candidates = predict( data, candidates, predicted, estimates, buf );
+                stages.add( profiler::PREDICT, start, data.size() );
+            }
+
+            auto start = now();
+            auto &measures = measure( data, candidates, buf );
+            stages.add( profiler::PACK, start, data.size() );
+            pace.learn( measures, data.size() );
+
+            auto slot1 = bundle::sort_smallest_encoders( measures, 100.00 - treshold ); // for_fastest_decompressor
+            auto slot2 = bundle::sort_fastest_decoders( measures );
+            bool skipped = slot1.empty();
+
+            const std::string &output = skipped ? input : measures[ slot1[0] ].packed;
+
+            double ratio = ::ratio( input.size(), output.size() );
+            bool ignored = ratio >= treshold;
+
+            bool valid = !skipped && !ignored;
+
+            if( !cachefile.empty() && measures.size() ) {
+                cache.learn( ext, valid ? bundle::name_of( measures[ slot1[0] ].q ) : "", ratio );
+            }
+
+            std::uint64_t offset = 0;
+            const std::string &payload = valid ? output : input;
+            bool written = writer.append( payload, offset );
+
+            with["offset"] = std::to_string( offset );
+            with["size"] = std::to_string( payload.size() );
+            with["crc"] = std::to_string( crc32c( payload ) );
+            if( valid ) {
+                with["encoder"] = bundle::name_of( measures[ slot1[0] ].q );
+            }
+            with.erase( "filter" );
+            if( valid && how.kind != filter::NONE ) {
+                with["filter"] = how.name();
+            }
+            //with["/**/"] = valid ? with.toc() : std::string();
+
+            mutex.lock();
+
+            if( !written ) {
+                screen.err() << "[FAIL] " << tmpfile << ": cannot write to disk" << std::endl;
+                numerrors ++;
+            }
+
+            progress_idx += files;
+            progress_pct = (progress_idx * 100) / entries;
+            title_name = label;
+
+            if( !quiet ) {
+                std::string rank, sep;
+                if( valid ) {
+                    for( auto &slot : slot1 ) {
+                        rank += sep + bundle::name_of( measures[ slot ].q );
+                        sep = "<";
+                    }
+                    if( how.kind != filter::NONE ) {
+                        rank += ", " + how.name();
+                    }
+                    // update title w/ latest rank
+                    title_mode = mode + " (" + rank + ")";
+                } else {
+                    rank = raw ? "incompressible" : "skipped";
+                }
+                screen.out() << "[ OK ] " /*<< title_mode << ": "*/ << label << ": " << len << " -> " << output.size() << " (" << ratio << "%) (" << rank << ")" << std::endl;
+
+                if( verbose && estimates.size() ) {
+                    auto line = screen.out();
+                    line << "\tpredicted:";
+                    for( auto &m : measures ) {
+                        line << ' ' << bundle::name_of( m.q ) << "=" << estimates[ m.q ] << "% (actual " << ::ratio( input.size(), m.packed.size() ) << "%)";
+                    }
+                    line << std::endl;
+                }
+            }
+
+            total_input += len;
+            total_output += valid ? output.size() : input.size();
+            done_output += valid ? output.size() : input.size();
+            pace.done += len;
+            done_bytes += len;
+            if( raw ) {
+                bypassed++;
+                bypassed_bytes += input.size();
+            }
+
+            mutex.unlock();
+        };
+
+        // files packed in chunks. every chunk job records its part here; the last one to complete finalizes the entry.
+        struct progress_t {
+            std::mutex mutex;
+            std::vector<std::string> parts;
+            std::string hashes;
+            std::map<std::string, bool> encoders;
+            std::uint64_t left = 0;
+            std::condition_variable drained;
+        };
+
+        auto finalize = [&]( int idx, progress_t &state ) {
+            auto &with = entry( idx );
+            std::string chunks, encoders, sep;
+            for( auto &p : state.parts ) {
+                chunks += sep + p;
+                sep = ",";
+            }
+            sep.clear();
+            for( auto &e : state.encoders ) {
+                encoders += sep + e.first;
+                sep = ",";
+            }
+            with["chunks"] = chunks;
+            with["hash"] = std::to_string( hash64( state.hashes ) );
+            if( encoders.size() ) {
+                with["encoder"] = encoders;
+            }
+
+            std::lock_guard<std::mutex> lock( mutex );
+            progress_pct = (++progress_idx * 100) / entries;
+        };
+
+        auto packchunk = [&]( int idx, std::shared_ptr<progress_t> state, std::uint64_t k, const std::string &input, bool ok, const std::string &label, const std::string &ext, arena &buf ) {
+            bundle::file part;
+            if( ok ) {
+                store( part, input, input.size(), label, ext, 0, buf );
+            }
+
+            std::lock_guard<std::mutex> lock( state->mutex );
+            state->parts[ size_t( k ) ] = part["offset"] + ":" + part["size"] + ":" + std::to_string( input.size() ) + ":" + part["crc"] + ":" + std::to_string( crc32c( input ) );
+            if( part.count("filter") ) {
+                state->parts[ size_t( k ) ] += ":" + part["filter"];
+            }
+            state->parts[ size_t( k ) ] += ":" + ( part.count("encoder") ? part["encoder"] : std::string( "stored" ) );
+            std::string hash;
+            put64( hash, hash64( input ) );
+            state->hashes.replace( size_t( k * 8 ), 8, hash );
+            if( part.count("encoder") ) {
+                state->encoders[ part["encoder"] ] = true;
+            }
+            if( 0 == --state->left ) {
+                finalize( idx, *state );
+            }
+            state->drained.notify_all();
+        };
+
+        // small files are packed together in solid blocks when requested. they are sorted by extension,
+        // so similar contents end up in the same block.
+        struct member {
+            int idx;
+            std::string filename;
+            std::uint64_t len, mtime;
+        };
+        std::vector<member> smalls;
+
+        std::string dictref; // offset:size of the shared dictionary, once trained
+
+        // packs a whole file as a single payload. files smaller than the dictionary size are first rewritten with
+        // the shared dictionary, when there is one and it helps: substitution can shrink the raw size and still pack
+        // worse, so both versions are trial packed by every encoder and the dictionary is kept only if it packs smaller.
+        auto packfile = [&]( int idx, const std::string &filename, std::uint64_t len, std::uint64_t mtime, std::shared_ptr<dictionary> dict ) {
+            pool.push( [&,idx,filename,len,mtime,dict]( unsigned worker ) {
+
+                auto &with = entry( idx );
+                auto &buf = arenas[ worker ];
+                const std::string name = flat ? flatten( normalize(filename) ) : normalize(filename);
+
+                if( unchanged( idx, filename, name, len, mtime ) ) {
+                    return;
+                }
+
+                const std::string &input = buf.input;
+                if( !readfile( filename, buf.input ) ) {
+                    return;
+                }
+
+                std::uint64_t hash = hash64( input );
+
+                with["name"] = name;
+                with["len"] = std::to_string( input.size() );
+                with["mtime"] = std::to_string( mtime );
+                with["hash"] = std::to_string( hash );
+                std::uint32_t sum = crc32c( input );
+                with["sum"] = std::to_string( sum );
+
+                if( duplicate( idx, filename, input, hash, sum ) ) {
+                    return;
+                }
+
+                // smallest packed size of given data over every encoder, or its raw size when none packs it
+                auto smallest = [&]( const std::string &data ) -> size_t {
+                    size_t best = data.size();
+                    for( auto &q : encoders ) {
+                        if( bundle::pack( q, buf.packed, data ) ) {
+                            best = (std::min)( best, buf.packed.size() );
+                        }
+                    }
+                    return best;
+                };
+
+                if( dict && input.size() < dictsize ) {
+                    dict->encode( input, buf.block );
+                    if( buf.block.size() < input.size() && smallest( buf.block ) < smallest( input ) ) {
+                        with["dict"] = dictref;
+                        store( with, buf.block, input.size(), filename, learncache::key( filename ), 1, buf );
+                        buf.trim();
+                        return;
+                    }
+                }
+
+                store( with, input, input.size(), filename, learncache::key( filename ), 1, buf );
+                buf.trim();
+            }, cost_of( len ) );
+        };
+
+        // small files wait until enough of them are found to train the dictionary from, then are packed with it.
+        // the dictionary is stored once, as a payload of its own that entries refer to.
+        std::shared_ptr<dictionary> dict;
+        std::vector<member> waiting;
+        bool trained = !dictsize;
+        auto train = [&]() {
+            trained = true;
+            std::vector<std::string> samples;
+            size_t sampled = 0;
+            auto start = now();
+            for( size_t i = 0; i < waiting.size() && sampled < 1024 * 1024; ++i ) {
+                std::string data;
+                if( readinto( waiting[i].filename, data ) ) {
+                    sampled += data.size();
+                    samples.push_back( std::move( data ) );
+                }
+            }
+            auto trainee = std::make_shared<dictionary>();
+            if( trainee->train( samples ) ) {
+                std::string saved = trainee->save();
+                std::uint64_t offset = 0;
+                if( writer.append( saved, offset ) ) {
+                    dict = trainee;
+                    dictref = std::to_string( offset ) + ":" + std::to_string( saved.size() );
+                    std::lock_guard<std::mutex> lock( mutex );
+                    total_output += saved.size();
+                    done_output += saved.size();
+                    if( verbose ) {
+                        screen.out() << "[ OK ] dictionary: " << dict->tokens.size() << " tokens from " << samples.size() << " files (" << saved.size() << " bytes)" << std::endl;
                     }
                 }
             }
-        } else {
-            // regular file or mask
-            to_pack.include( args[i], {"*"}, recursive );
-        }
-    }
+            stages.add( profiler::TRAIN, start, sampled );
+            for( auto &m : waiting ) {
+                packfile( m.idx, m.filename, m.len, m.mtime, dict );
+            }
+            waiting.clear();
+        };
 
-    if( encoders.empty() ) {
-        encoders.push_back( bundle::LZMA20 );
-    }
+        // directories are walked while files found so far are being packed
+        scanner scan( max_threads, recursive );
+        for( auto &path : to_pack ) {
+            scan.include( path );
+        }
+        scan.close();
+
+        std::vector<std::string> moved;
+        for( scanner::file found; scan.next( found ); ) {
+            const std::string &filename = found.path;
+            const std::uint64_t len = found.size, mtime = found.mtime;
+            int idx = append();
+            entries = scan.size() + from_stdin;
+            given[ flat ? flatten( normalize(filename) ) : normalize(filename) ] = true;
+            if( moveit ) {
+                moved.push_back( filename );
+            }
 
-    if( fast_encoders.empty() ) {
-        fast_encoders.push_back( bundle::LZMA20 );
-    }
+            pace.found += len;
+            expected_bytes += len;
 
-    if( (packit || moveit) && to_pack.empty() ) {
-        std::cout << help(args[0]);
-        std::cout << "No files provided." << std::endl;
-        return -1;
-    }
+            if( solid && len < solid / 4 ) {
+                smalls.push_back( member { idx, filename, len, mtime } );
+                continue;
+            }
 
-    int progress_pct = 0, progress_idx = 0, appexit = 0;
-    std::string title_mode, title_name;
-    std::thread bubble( [&]() {
-        if( !quiet )
-        bubble::show( bubble::string() <<
-            "title.text=" << BUNDLER_TEXT ";"
-            "body.icon=8;"
-            "head.text=;"
-            "body.text=;"
-            "style.minimizable=1;"
-//          "style.minimized=1;"
-            "progress=0;",
-            [&]( bubble::vars &vars ) {
-                vars["head.text"] = title_mode;
-                vars["title.text"] = std::string() + BUNDLER_TEXT " - " + std::to_string( progress_pct > 100 ? 100 : progress_pct ) + "%";
-                vars["progress"] = progress_pct;
-                vars["body.text"] = title_name;
-                if( appexit ) vars["exit"] = 0;
+            if( len < dictsize ) {
+                if( trained ) {
+                    packfile( idx, filename, len, mtime, dict );
+                    continue;
+                }
+                waiting.push_back( member { idx, filename, len, mtime } );
+                if( waiting.size() >= 256 ) {
+                    train();
+                }
+                continue;
             }
-        );
-    } ) ;
 
-    auto readfile = [&]( const std::string &pathfile ) -> std::pair<bool,std::string> {
-        std::stringstream ss;
-        std::ifstream file( pathfile.c_str(), std::ios::binary | std::ios::ate);
-        if( file.good() && !file.tellg() )
-            return std::pair<bool,std::string>( true, std::string() );
-        std::ifstream ifs( pathfile.c_str(), std::ios::binary );
-        if( ifs.good() ) {
-            if( ss << ifs.rdbuf() )
-                return std::pair<bool,std::string>( true, ss.str() );
-        }
-        std::cerr << "[FAIL] " << pathfile << ": cannot read file" << std::endl;
-        numerrors ++;
-        return std::pair<bool,std::string>( false, std::string() );
-    };
+            if( chunk && len > chunk ) {
+                pool.push( [&,idx,filename,len,mtime]( unsigned ) {
+                    auto &with = entry( idx );
+                    const std::string name = flat ? flatten( normalize(filename) ) : normalize(filename);
 
-    auto writefile = [&]( const std::string &pathfile, const std::string &data ) -> bool {
-        std::ofstream ofs( pathfile.c_str(), std::ios::binary );
-        if( ofs.good() ) {
-            ofs.write( &data[0], data.size() );
-            if( ofs.good() ) {
-                return true;
-            }
-        }
-        std::cerr << "[FAIL] " << pathfile << ": cannot write to disk" << std::endl;
-        numerrors ++;
-        return false;
-    };
+                    if( unchanged( idx, filename, name, len, mtime ) ) {
+                        return;
+                    }
 
-    auto flatten = []( const std::string &pathfile ) -> std::string {
-        unsigned a = pathfile.find_last_of('/'); a = ( a == std::string::npos ? 0 : a + 1 );
-        unsigned b = pathfile.find_last_of('\\'); b = ( b == std::string::npos ? 0 : b + 1 );
-        return pathfile.substr( a > b ? a : b );
-    };
+                    // every chunk is an independent job. the last chunk to finish completes the entry.
+                    auto state = std::make_shared<progress_t>();
+                    std::uint64_t count = ( len + chunk - 1 ) / chunk;
+                    state->parts.resize( size_t( count ) );
+                    state->hashes.resize( size_t( count * 8 ) );
+                    state->left = count;
+
+                    with["name"] = name;
+                    with["len"] = std::to_string( len );
+                    with["mtime"] = std::to_string( mtime );
+                    with["chunk"] = std::to_string( chunk );
+
+                    for( std::uint64_t k = 0; k < count; ++k ) {
+                        pool.push( [&,idx,filename,state,count,k]( unsigned worker ) {
+                            auto &buf = arenas[ worker ];
+                            std::string &input = buf.input;
+                            bool ok = readinto( filename, input, k * chunk, chunk );
+                            if( !ok ) {
+                                std::lock_guard<std::mutex> lock( mutex );
+                                screen.err() << "[FAIL] " << filename << ": cannot read file" << std::endl;
+                                numerrors ++;
+                            }
+
+                            std::string label = filename + " [" + std::to_string( k + 1 ) + "/" + std::to_string( count ) + "]";
+                            packchunk( idx, state, k, input, ok, label, learncache::key( filename ), buf );
+                            buf.trim();
+                        }, cost_of( chunk ) );
+                    }
+                } );
+                continue;
+            }
 
-    auto normalize = []( std::string pathfile ) -> std::string {
-        for( auto &p : pathfile ) {
-            if( p == '\\' ) p = '/';
-            if( p == ':' ) p = '/';
+            packfile( idx, filename, len, mtime, nullptr );
         }
-        return pathfile.size() && pathfile[0] == '/' ? pathfile.substr(1) : pathfile;
-    };
 
-    // app starts here
-
-    std::vector<std::thread> threads;
-    auto wait_for_threads = [&]() {
-        for( auto &in : threads ) {
-            if( in.joinable() ) {
-                in.join();
+        for( auto &skipped : scan.skipped() ) {
+            if( !quiet ) {
+                screen.out() << "[SKIP] " << skipped.first << ": " << skipped.second << std::endl;
             }
         }
-    };
-
-    progress_idx = 0;
-
-    if( moveit || packit ) {
 
-        bool single_thread = false;
-        for( auto &PACKING_ALGORITHM : encoders ) {
-            if( PACKING_ALGORITHM == bundle::ZPAQ || PACKING_ALGORITHM == bundle::BROTLI11 || PACKING_ALGORITHM == bundle::BROTLI9 ) {
-                single_thread = true;
-            }
+        if( !trained ) {
+            train();
         }
 
-        std::string algorithms;
-        for( auto &u : encoders ) { algorithms += std::string( bundle::name_of(u) ) + ","; }
-        if( algorithms.size() ) algorithms.pop_back();
-        title_mode = std::string() + ( packit ? "pack" : "move" ) + " (" + algorithms + ")";
+        // standard input is read on this thread in blocks, which are packed by the pool as the chunks of a single entry.
+        // only a few blocks per worker are in flight at any time, so memory stays bounded whatever the input size.
+        if( from_stdin ) {
+            int idx = append();
+            auto &with = entry( idx );
+            given[ "stdin" ] = true;
+            const std::uint64_t block = chunk ? chunk : 1024 * 1024;
+            const std::uint64_t window = 2 * pool.size();
+#ifdef _WIN32
+            _setmode( _fileno( stdin ), _O_BINARY );
+#endif
+            auto state = std::make_shared<progress_t>();
+            state->left = 1; // held by this reader until the input ends
+
+            std::uint64_t len = 0;
+            for( std::uint64_t k = 0; ; ++k ) {
+                auto input = std::make_shared<std::string>( size_t( block ), '\0' );
+                input->resize( fread( &(*input)[0], 1, input->size(), stdin ) );
+                bool ok = !ferror( stdin ), last = !ok || input->size() < block;
+                if( ok && input->empty() && k ) {
+                    break;
+                }
+                len += input->size();
+
+                {
+                    std::unique_lock<std::mutex> lock( state->mutex );
+                    state->drained.wait( lock, [&]{ return state->left <= window; } );
+                    state->parts.resize( size_t( k + 1 ) );
+                    state->hashes.resize( size_t( ( k + 1 ) * 8 ) );
+                    state->left++;
+                }
 
-        archived.resize( to_pack.size() );
+                if( !ok ) {
+                    std::lock_guard<std::mutex> lock( mutex );
+                    screen.err() << "[FAIL] stdin: cannot read stream" << std::endl;
+                    numerrors ++;
+                }
 
-        for( auto &file : to_pack ) {
-            progress_pct = (++progress_idx * 100) / to_pack.size();
+                pool.push( [&,idx,state,input,ok,k]( unsigned worker ) {
+                    auto &buf = arenas[ worker ];
+                    packchunk( idx, state, k, *input, ok, "stdin [" + std::to_string( k + 1 ) + "]", ".", buf );
+                    buf.trim();
+                }, cost_of( input->size() ) );
 
-            if( file.is_dir() ) {
-                title_name.clear();
-                continue;
-            } else {
-                title_name = file.name();
+                if( last ) {
+                    break;
+                }
             }
 
-            static std::mutex mutex;
+            with["name"] = "stdin";
+            with["len"] = std::to_string( len );
+            with["mtime"] = std::to_string( std::uint64_t( std::time( 0 ) ) );
+            with["chunk"] = std::to_string( block );
 
-            threads.emplace_back( [&]( int idx, std::string filename ){
+            std::lock_guard<std::mutex> lock( state->mutex );
+            if( 0 == --state->left ) {
+                finalize( idx, *state );
+            }
+        }
 
-                auto &with = archived[idx];
+        for( size_t old = 0; old < previous.size(); ++old ) {
+            if( !given.count( previous[old]["name"] ) ) {
+                int idx = append();
+                entries++;
+                pool.push( [&,idx,old]( unsigned ) {
+                    reuse( idx, old );
+                } );
+            }
+        }
 
-                auto pair = readfile( filename );
-                const std::string &input = pair.second;
+        if( !processed ) {
+            screen.err() << "[FAIL] " << archive << ": no files found" << std::endl;
+            numerrors ++;
+        }
 
-                if( !pair.first ) {
-                    return;
-                }
+        std::stable_sort( smalls.begin(), smalls.end(), []( const member &a, const member &b ) {
+            return learncache::key( a.filename ) < learncache::key( b.filename );
+        } );
 
-                auto measures = bundle::measures( input, lte && (input.size() >= lte) * 1024 ? fast_encoders : encoders );
+        for( size_t begin = 0, end = smalls.size(), blocks = 0; begin < end; ++blocks ) {
+            std::vector<member> block;
+            std::uint64_t size = 0;
+            for( ; begin < end && ( block.empty() || size + smalls[begin].len <= solid ); size += smalls[begin++].len ) {
+                block.push_back( smalls[begin] );
+            }
 
-                auto slot1 = bundle::sort_smallest_encoders( measures, 100.00 - treshold ); // for_fastest_decompressor
-                auto slot2 = bundle::sort_fastest_decoders( measures );
-                bool skipped = slot1.empty();
+            pool.push( [&,block,blocks]( unsigned worker ) {
+                auto &buf = arenas[ worker ];
+                std::string &data = buf.block;
+                std::vector<int> packed;
+                data.clear();
 
-                const std::string &output = skipped ? input : measures[ slot1[0] ].packed;
+                for( auto &m : block ) {
+                    auto &with = entry( m.idx );
+                    const std::string name = flat ? flatten( normalize(m.filename) ) : normalize(m.filename);
 
-                double ratio = ::ratio( input.size(), output.size() );
-                bool ignored = ratio >= treshold;
+                    if( unchanged( m.idx, m.filename, name, m.len, m.mtime ) ) {
+                        continue;
+                    }
 
-                bool valid = !skipped && !ignored;
+                    const std::string &input = buf.input;
+                    if( !readfile( m.filename, buf.input ) ) {
+                        continue;
+                    }
 
-                with["name"] = flat ? flatten( normalize(filename) ) : normalize(filename);
-                with["data"] = valid ? output : input;
-                //with["/**/"] = valid ? with.toc() : std::string();
+                    std::uint64_t hash = hash64( input );
 
-                mutex.lock();
+                    with["name"] = name;
+                    with["len"] = std::to_string( input.size() );
+                    with["mtime"] = std::to_string( m.mtime );
+                    with["hash"] = std::to_string( hash );
+                    std::uint32_t sum = crc32c( input );
+                    with["sum"] = std::to_string( sum );
 
-                if( !quiet ) {
-                    std::string rank, sep;
-                    if( valid ) {
-                        for( auto &slot : slot1 ) {
-                            rank += sep + bundle::name_of( measures[ slot ].q );
-                            sep = "<";
-                        }
-                        // update title w/ latest rank
-                        title_mode = std::string() + ( packit ? "pack" : "move" ) + " (" + rank + ")";
-                    } else {
-                        rank = "skipped";
+                    if( duplicate( m.idx, m.filename, input, hash, sum ) ) {
+                        continue;
                     }
-                    std::cout << "[ OK ] " /*<< title_mode << ": "*/ << filename << ": " << input.size() << " -> " << output.size() << " (" << ratio << "%) (" << rank << ")" << std::endl;
-                }
 
-                total_input += input.size();
-                total_output += valid ? output.size() : input.size();
+                    with["solid"] = std::to_string( data.size() );
+                    data += input;
+                    packed.push_back( m.idx );
+                }
 
-                mutex.unlock();
-            }, processed++, file.name() );
+                if( packed.empty() ) {
+                    return;
+                }
 
-            if( single_thread ) {
-                if( threads.back().joinable() ) {
-                    threads.back().join();
+                bundle::file blk;
+                std::string label = "solid block #" + std::to_string( blocks ) + " (" + std::to_string( packed.size() ) + " files)";
+                store( blk, data, data.size(), label, learncache::key( block[0].filename ), int( packed.size() ), buf );
+
+                for( auto &idx : packed ) {
+                    auto &with = entry( idx );
+                    with["offset"] = blk["offset"];
+                    with["size"] = blk["size"];
+                    with["crc"] = blk["crc"];
+                    if( blk.count("filter") ) {
+                        with["filter"] = blk["filter"];
+                    }
+                    if( blk.count("encoder") ) {
+                        with["encoder"] = blk["encoder"];
+                    }
                 }
-            }
+                buf.trim();
+            }, cost_of( size ) );
+        }
 
-            if( threads.size() > max_threads ) {
-                wait_for_threads();
-                threads.clear();
+        pool.wait();
+        progress_pct = 101; // show marquee
+
+        archived.assign( listing.begin(), listing.end() );
+        listing.clear();
+
+        for( auto &link : links ) {
+            auto &with = archived[ link.first ], &owner = archived[ link.second ];
+            with["link"] = owner["name"];
+            with["offset"] = owner["offset"];
+            with["size"] = owner["size"];
+            with.erase( "crc" );
+            if( owner.count("crc") ) {
+                with["crc"] = owner["crc"];
+            }
+            with.erase( "encoder" );
+            if( owner.count("encoder") ) {
+                with["encoder"] = owner["encoder"];
+            }
+            with.erase( "dict" );
+            if( owner.count("dict") ) {
+                with["dict"] = owner["dict"];
+            }
+            with.erase( "filter" );
+            if( owner.count("filter") ) {
+                with["filter"] = owner["filter"];
+            }
+            // duplicates of a solid member share its slice. entries reused from a previous archive keep their own.
+            if( owner.count("solid") && !with.count("solid") ) {
+                with["solid"] = owner["solid"];
             }
         }
 
-        wait_for_threads();
-        progress_pct = 101; // show marquee
+        // entries are found and finished in whatever order the threads run: the index is sorted by name, so listings
+        // and extraction order do not change from run to run. links are resolved above, by index, before this.
+        std::stable_sort( archived.begin(), archived.end(), []( const bundle::file &a, const bundle::file &b ) {
+            auto x = a.find( "name" ), y = b.find( "name" );
+            return x != a.end() && ( y == b.end() || x->second < y->second );
+        } );
+
+        if( verbose ) {
+            screen.out() << pool.report();
+            screen.out() << pace.report();
+        }
+
+        if( !cachefile.empty() && !cache.save( cachefile ) ) {
+            screen.err() << "[FAIL] " << cachefile << ": cannot write to disk" << std::endl;
+        }
 
         if( 0 == numerrors ) {
             if( !quiet ) {
-                std::cout << "[    ] flushing to disk..." << '\r';
+                screen.out() << "[    ] flushing to disk..." << '\r';
             }
             archived.resize( processed );
-            bool ok = writefile( archive, archived.bnd() );
+            bool ok = writer.close( archived );
+            reader.map.close();
+#ifdef _WIN32
+            std::remove( archive.c_str() );
+#endif
+            ok = ok && 0 == std::rename( tmpfile.c_str(), archive.c_str() );
+            if( !ok ) {
+                screen.err() << "[FAIL] " << archive << ": cannot write to disk" << std::endl;
+                numerrors ++;
+            }
             if( !quiet ) {
-                std::cout << ( ok ? "[ OK ] " : "[FAIL] " ) << "flushing to disk..." << std::endl;
+                screen.out() << ( ok ? "[ OK ] " : "[FAIL] " ) << "flushing to disk..." << std::endl;
             }
         }
 
+        if( 0 != numerrors ) {
+            writer.ofs.close();
+            std::remove( tmpfile.c_str() );
+        }
+
+        if( verbose ) {
+            screen.out() << stages.report();
+        }
+
         if( 0 == numerrors && verbose ) {
-            std::cout << "TOC " << archived.toc() << std::endl;
+            screen.out() << "TOC " << archived.toc() << std::endl;
         }
 
         if( 0 == numerrors && moveit ) {
-            for( auto &file : to_pack ) {
+            for( auto &file : moved ) {
                 bool ok = sao::file( file ).remove();
                 if( !ok ) numerrors ++;
-                if( !ok ) std::cout << "[FAIL] cannot delete file: " << file.name() << std::endl;
+                if( !ok ) screen.out() << "[FAIL] cannot delete file: " << file << std::endl;
             }
         }
 
-    } else {
-        // testit, listit or extractit
-        title_mode = listit ? "list" : (testit ? "test" : "extract");
+    } else if( benchit ) {
+        // every encoder packs and unpacks the whole file set once per run, for every thread count.
+        // throughputs come from the bundle::measures timings of the busiest worker, so they include contention.
+        std::vector< std::pair<std::string, std::string> > inputs;
+        std::uint64_t bytes = 0;
+        scanner scan( max_threads, recursive );
+        for( auto &path : to_pack ) {
+            scan.include( path );
+        }
+        scan.close();
+        for( scanner::file found; scan.next( found ); ) {
+            std::string input;
+            if( readfile( found.path, input ) && input.size() ) {
+                bytes += input.size();
+                inputs.push_back( std::make_pair( found.path, std::move( input ) ) );
+            }
+        }
+        processed = int( inputs.size() );
 
-        {
-            auto result = readfile( archive );
-            if( 0 == numerrors ) {
-                archived.bnd( result.second );
+        std::vector<unsigned> sweep;
+        for( unsigned t = 1; t < max_threads; t *= 2 ) {
+            sweep.push_back( t );
+        }
+        sweep.push_back( max_threads ? max_threads : 1 );
+
+        struct row {
+            unsigned q, threads;
+            std::uint64_t packed, estimated, rss;
+            double comp, dec;   // MB/s, median of the measured runs
+            bool pass;
+        };
+        std::vector<row> rows;
+
+        auto median = []( std::vector<double> v ) -> double {
+            if( v.empty() ) return 0;
+            std::sort( v.begin(), v.end() );
+            return v.size() % 2 ? v[ v.size() / 2 ] : ( v[ v.size() / 2 - 1 ] + v[ v.size() / 2 ] ) / 2;
+        };
+
+        for( auto &threads : sweep ) {
+            for( auto &q : encoders ) {
+                title_mode = std::string() + "bench (" + bundle::name_of(q) + ", " + std::to_string( threads ) + " threads)";
+                row r = row { q, threads, 0, 0, 0, 0, 0, true };
+                std::vector<double> comp, dec;
+                bool measurable = reset_peak_rss();   // otherwise the peak spans earlier rows and is not reported
+
+                for( unsigned run = 0, runs = warmups + ( repeats ? repeats : 1 ); run < runs; ++run ) {
+                    progress_pct = ( run * 100 ) / runs;
+
+                    workpool pool( threads, memlimit );
+                    std::vector<double> enctime( pool.size() ), dectime( pool.size() ); // microseconds, per worker
+                    std::uint64_t packed = 0;
+                    bool pass = true;
+                    std::mutex mutex;
+
+                    for( auto &in : inputs ) {
+                        const std::string *input = &in.second;
+                        std::uint64_t cost = input->size() + bundle::bound( q, input->size() ) + workingset( q, input->size() );
+                        pool.push( [&,input]( unsigned id ) {
+                            auto measures = bundle::measures( *input, std::vector<unsigned>( 1, q ) );
+                            enctime[id] += measures[0].enctime;
+                            dectime[id] += measures[0].dectime;
+                            std::lock_guard<std::mutex> lock( mutex );
+                            packed += measures[0].packed.size();
+                            pass = pass && measures[0].pass;
+                        }, cost );
+                    }
+                    pool.wait();
+
+                    r.pass = r.pass && pass;
+                    r.packed = packed;
+                    r.estimated = (std::max)( r.estimated, pool.peak_memory() );
+                    if( run >= warmups ) {
+                        double enc = *std::max_element( enctime.begin(), enctime.end() );
+                        double dec_ = *std::max_element( dectime.begin(), dectime.end() );
+                        comp.push_back( enc > 0 ? bytes / enc : 0 );  // bytes per microsecond = MB/s
+                        dec.push_back( dec_ > 0 ? bytes / dec_ : 0 );
+                    }
+                }
+
+                r.comp = median( comp );
+                r.dec = median( dec );
+                r.rss = measurable ? peak_rss() : 0;
+                rows.push_back( r );
+
+                if( !r.pass ) {
+                    numerrors ++;
+                }
+                if( !quiet || !r.pass ) {
+                    screen.out() << ( r.pass ? "[ OK ] " : "[FAIL] " ) << bundle::name_of(q) << " x" << threads << ": " << bytes << " -> " << r.packed << " (" << ratio( bytes, r.packed ) << "%), "
+                        << r.comp << " MB/s packing, " << r.dec << " MB/s unpacking, " << ( r.estimated / 1024 / 1024 ) << " MiB estimated, "
+                        << ( r.rss ? std::to_string( r.rss / 1024 / 1024 ) + " MiB peak rss" : std::string( "peak rss n/a" ) ) << std::endl;
+                }
+            }
+        }
+
+        // report goes to a .json file when requested, or to a .csv file otherwise
+        bool json = archive.size() >= 5 && wire::string( archive.substr( archive.size() - 5 ) ).lowercase() == ".json";
+        std::ofstream ofs( archive.c_str(), std::ios::binary );
+        ofs << ( json ? "[\n" : "encoder,threads,files,bytes_in,bytes_out,ratio,comp_mbs,dec_mbs,estimated_mb,rss_mb,warmups,repeats,pass\n" );
+        for( size_t i = 0; i < rows.size(); ++i ) {
+            auto &r = rows[i];
+            if( json ) {
+                ofs << "  { \"encoder\": \"" << bundle::name_of( r.q ) << "\", \"threads\": " << r.threads << ", \"files\": " << inputs.size()
+                    << ", \"bytes_in\": " << bytes << ", \"bytes_out\": " << r.packed << ", \"ratio\": " << ratio( bytes, r.packed )
+                    << ", \"comp_mbs\": " << r.comp << ", \"dec_mbs\": " << r.dec << ", \"estimated_mb\": " << ( r.estimated / 1024 / 1024 )
+                    << ", \"rss_mb\": " << ( r.rss ? std::to_string( r.rss / 1024 / 1024 ) : std::string( "null" ) ) << ", \"warmups\": " << warmups << ", \"repeats\": " << repeats
+                    << ", \"pass\": " << ( r.pass ? "true" : "false" ) << " }" << ( i + 1 < rows.size() ? "," : "" ) << "\n";
+            } else {
+                ofs << bundle::name_of( r.q ) << ',' << r.threads << ',' << inputs.size() << ',' << bytes << ',' << r.packed << ',' << ratio( bytes, r.packed ) << ','
+                    << r.comp << ',' << r.dec << ',' << ( r.estimated / 1024 / 1024 ) << ',' << ( r.rss ? std::to_string( r.rss / 1024 / 1024 ) : std::string() ) << ',' << warmups << ',' << repeats << ',' << r.pass << "\n";
             }
         }
+        ofs << ( json ? "]\n" : "" );
+        ofs.close();
+        if( ofs.fail() ) {
+            screen.err() << "[FAIL] " << archive << ": cannot write to disk" << std::endl;
+            numerrors ++;
+        }
+
+    } else {
+        // testit, vrfyit, listit or extractit
+        title_mode = listit ? "list" : (testit ? "test" : (vrfyit ? "verify" : "extract"));
+
+        bndreader reader;
+        if( !reader.open( archive, archived ) ) {
+            screen.err() << "[FAIL] " << archive << ": cannot read file" << std::endl;
+            numerrors ++;
+            archived.clear();
+        }
 
-        auto is_ok = []( std::string &output, const std::string &input ) -> bool {
-            if( bundle::is_packed( input ) ) {
-                return bundle::unpack(output, input);
+        // payloads are decoded when the index says they were packed, and copied as they are when stored.
+        // legacy archives do not say: their payloads are told apart by the bundle header.
+        enum { STORED, PACKED, UNKNOWN };
+        auto is_ok = []( std::string &output, const std::string &input, int packed ) -> bool {
+            if( packed == UNKNOWN ) {
+                packed = bundle::is_packed( input ) ? PACKED : STORED;
+            }
+            if( packed == PACKED ) {
+                return bundle::is_packed( input ) && bundle::unpack(output, input);
             } else {
-                return bundle::unpack(output, input), true;
+                return output = input, true;
             }
         };
 
+        // resolve masks against the index. plain names are looked up directly; payloads of unselected entries are never touched.
+        std::vector<size_t> selected;
+        if( masks.empty() ) {
+            for( size_t idx = 0, end = archived.size(); idx < end; ++idx ) {
+                selected.push_back( idx );
+            }
+        } else {
+            std::map<std::string, size_t> names;
+            for( size_t idx = 0, end = archived.size(); idx < end; ++idx ) {
+                names.insert( std::make_pair( archived[idx]["name"], idx ) );
+            }
+            // like tar and zip, a mask that selects nothing is an error, so a mistyped name does not pass for success
+            std::vector<bool> found( archived.size() );
+            for( auto &mask : masks ) {
+                std::string name = normalize( mask );
+                bool matched = false;
+                if( name.find_first_of("*?") == std::string::npos ) {
+                    auto it = names.find( name );
+                    if( it != names.end() ) {
+                        found[ it->second ] = matched = true;
+                    }
+                } else {
+                    for( size_t idx = 0, end = archived.size(); idx < end; ++idx ) {
+                        if( wire::string( archived[idx]["name"] ).matches( name ) ) {
+                            found[idx] = matched = true;
+                        }
+                    }
+                }
+                if( !matched ) {
+                    screen.err() << "[FAIL] " << mask << ": not found in archive" << std::endl;
+                    numerrors ++;
+                }
+            }
+            for( size_t idx = 0, end = archived.size(); idx < end; ++idx ) {
+                if( found[idx] ) {
+                    selected.push_back( idx );
+                }
+            }
+        }
+        if( excludes.size() ) {
+            auto excluded = [&]( size_t idx ) {
+                for( auto &mask : excludes ) {
+                    if( wire::string( archived[idx]["name"] ).matches( normalize( mask ) ) ) {
+                        return true;
+                    }
+                }
+                return false;
+            };
+            selected.erase( std::remove_if( selected.begin(), selected.end(), excluded ), selected.end() );
+        }
+
         if( listit ) {
-            std::cout << archived.toc() << std::endl;
+            if( selected.size() == archived.size() ) {
+                screen.out() << archived.toc() << std::endl;
+            } else {
+                bundle::archive listed;
+                for( auto &idx : selected ) {
+                    listed.push_back( archived[idx] );
+                }
+                screen.out() << listed.toc() << std::endl;
+            }
+        }
+
+        // every selected entry is made of pieces: one per chunk for files packed in chunks, or a single one otherwise.
+        // pieces sharing a payload (solid blocks and duplicates) are decoded once, as a single unit.
+        struct piece {
+            size_t n;                   // selected entry
+            std::uint64_t offset, size; // payload, on streamed archives
+            std::uint64_t at, len;      // slice of decoded payload, on solid blocks
+            std::uint64_t unpacked;     // decoded payload size (a lower bound on solid blocks)
+            bool sliced, first, last;
+            bool has_crc, has_sum;      // checksums of payload and contents, on archives that store them
+            std::uint32_t crc, sum;
+            std::string filter;         // filter to revert once decoded, if any
+            int packed;                 // PACKED, STORED, or UNKNOWN on archives that do not record it
+        };
+        // index fields are checked before anything is decoded: entries with malformed numbers, or payloads out of the
+        // archive, are reported as a corrupt index and left out.
+        std::vector<piece> pieces;
+        for( size_t n = 0; n < selected.size(); ++n ) {
+            auto &file = archived[ selected[n] ];
+            std::vector<piece> parts;
+            bool valid = true;
+            if( file.count("chunks") ) {
+                wire::strings chunks = wire::string( file["chunks"] ).tokenize(",");
+                for( size_t i = 0; i < chunks.size(); ++i ) {
+                    wire::strings fields = chunks[i].tokenize(":");
+                    // fields past the checksums name the filter, if any, then the encoder (or "stored")
+                    std::string filtered;
+                    int packed = file.count("encoder") ? UNKNOWN : STORED;
+                    for( size_t f = 5; f < fields.size(); ++f ) {
+                        filter how;
+                        if( how.parse( fields[f] ) ) {
+                            filtered = fields[f];
+                        } else {
+                            packed = fields[f] == "stored" ? STORED : PACKED;
+                        }
+                    }
+                    std::uint64_t offset = 0, size = 0, unpacked = 0;
+                    std::uint32_t crc = 0, sum = 0;
+                    valid = valid && fields.size() >= 3 && to_u64( fields[0], offset ) && to_u64( fields[1], size ) && to_u64( fields[2], unpacked )
+                        && ( fields.size() < 4 || to_u32( fields[3], crc ) ) && ( fields.size() < 5 || to_u32( fields[4], sum ) ) && reader.holds( offset, size );
+                    parts.push_back( piece { n, offset, size, 0, 0, unpacked, false, i == 0, i + 1 == chunks.size(), fields.size() >= 4, fields.size() >= 5, crc, sum, filtered, packed } );
+                }
+            }
+            if( parts.empty() ) {
+                std::uint64_t offset = 0, size = 0, at = 0, len = 0;
+                std::uint32_t crc = 0, sum = 0;
+                bool sliced = file.count("solid") > 0;
+                if( reader.streamed ) {
+                    valid = to_u64( file["offset"], offset ) && to_u64( file["size"], size ) && reader.holds( offset, size );
+                }
+                valid = valid && ( !file.count("len") || to_u64( file["len"], len ) ) && ( !sliced || ( to_u64( file["solid"], at ) && file.count("len") && at <= ~len ) )
+                    && ( !file.count("crc") || to_u32( file["crc"], crc ) ) && ( !file.count("sum") || to_u32( file["sum"], sum ) );
+                std::uint64_t unpacked = sliced ? at + len : ( file.count("len") ? len : size );
+                int packed = !reader.streamed ? UNKNOWN : ( file.count("encoder") && !file["encoder"].empty() ? PACKED : STORED );
+                parts.push_back( piece { n, offset, size, at, sliced ? len : 0, unpacked, sliced, true, true, file.count("crc") > 0, file.count("sum") > 0, crc, sum, file.count("filter") ? file["filter"] : std::string(), packed } );
+            }
+            if( !valid ) {
+                screen.err() << "[FAIL] " << archive << ": corrupt index entry for " << file["name"] << std::endl;
+                numerrors ++;
+                continue;
+            }
+            pieces.insert( pieces.end(), parts.begin(), parts.end() );
         }
 
-        for( auto &file : archived ) {
-            progress_pct = (++progress_idx * 100) / archived.size();
+        // progress is measured in decoded bytes, or in stored bytes when verifying
+        auto weight = [&]( const piece &pc ) -> std::uint64_t {
+            return vrfyit ? pc.size : ( pc.sliced ? pc.len : pc.unpacked );
+        };
+        for( auto &pc : pieces ) {
+            expected_bytes += weight( pc );
+        }
 
-#if 0
-            bool found = false;
-            for( auto &m : to_pack ) {
-                if( wire::string( file["name"] ).matches( m.name() ) ) {
-                    found = true;
-                    break;
+        std::vector< std::vector<size_t> > units;
+        std::vector<size_t> unit_of( pieces.size() );
+        {
+            std::map<std::string, size_t> payloads;
+            for( size_t p = 0; p < pieces.size(); ++p ) {
+                std::string key = reader.streamed ? std::to_string( pieces[p].offset ) + "+" + std::to_string( pieces[p].size ) : "#" + std::to_string( pieces[p].n );
+                auto found = payloads.find( key );
+                if( found == payloads.end() ) {
+                    found = payloads.insert( std::make_pair( key, units.size() ) ).first;
+                    units.push_back( std::vector<size_t>() );
                 }
+                units[ found->second ].push_back( p );
+                unit_of[p] = found->second;
             }
+        }
 
-            if( !found ) {
-                continue;
+        // units are decoded in the pool, while this thread writes pieces back in archive order.
+        // decoders never run more than a few units ahead of the writer, so memory stays bounded.
+        struct slot {
+            bool done = false, ok = true;
+            std::string data;
+        };
+        std::vector<slot> slots( pieces.size() );
+        std::mutex slots_mutex;
+        std::condition_variable slots_ready;
+
+        workpool pool( max_threads, memlimit );
+        const size_t window = 2 * pool.size();
+        size_t submitted = 0;
+
+        // decoding a unit takes its payload, the decoded data and the working set of its decoders
+        auto cost_of = [&]( size_t u ) -> std::uint64_t {
+            std::uint64_t packed = 0, unpacked = 0, largest = 0;
+            for( auto &p : units[u] ) {
+                packed = (std::max)( packed, pieces[p].size );
+                unpacked = (std::max)( unpacked, pieces[p].unpacked );
             }
-#endif
+            if( vrfyit ) {
+                return packed;
+            }
+            for( auto &q : wire::string( reader.encoder( archived[ selected[ pieces[ units[u][0] ].n ] ] ) ).tokenize(",") ) {
+                largest = (std::max)( largest, workingset( encoder_of( q ), unpacked ) );
+            }
+            return packed + unpacked + largest;
+        };
+
+        // shared dictionaries are loaded once, by the first unit that needs them, and reused by every thread
+        std::map< std::string, std::shared_ptr<dictionary> > dicts;
+        std::mutex dicts_mutex;
+        auto dictionary_of = [&]( const std::string &ref ) -> std::shared_ptr<dictionary> {
+            std::lock_guard<std::mutex> lock( dicts_mutex );
+            auto found = dicts.find( ref );
+            if( found == dicts.end() ) {
+                wire::strings fields = wire::string( ref ).tokenize(":");
+                std::string saved;
+                auto d = std::make_shared<dictionary>();
+                bool ok = fields.size() == 2 && reader.payload( fields[0].as<std::uint64_t>(), fields[1].as<std::uint64_t>(), saved ) && d->load( saved );
+                found = dicts.insert( std::make_pair( ref, ok ? d : std::shared_ptr<dictionary>() ) ).first;
+            }
+            return found->second;
+        };
+
+        auto decode = [&]( size_t u ) {
+            pool.push( [&,u]( unsigned ) {
+                const auto &unit = units[u];
+                const piece &pc = pieces[ unit[0] ];
+                std::string input, uncmp;
+                auto start = now();
+                bool ok = reader.streamed ? reader.payload( pc.offset, pc.size, input ) : reader.payload( archived[ selected[pc.n] ], input );
+                stages.add( profiler::READ, start, input.size() );
+                if( ok && pc.has_crc ) {
+                    start = now();
+                    ok = crc32c( input ) == pc.crc;
+                    stages.add( profiler::CHECK, start, input.size() );
+                }
+                if( vrfyit ) {
+                    // stored payloads only: nothing is decoded
+                    std::lock_guard<std::mutex> lock( slots_mutex );
+                    for( auto &p : unit ) {
+                        slots[p].ok = ok;
+                        slots[p].done = true;
+                    }
+                    slots_ready.notify_all();
+                    return;
+                }
+                start = now();
+                ok = ok && is_ok( uncmp, input, pc.packed );
+                if( ok && !pc.filter.empty() ) {
+                    filter how;
+                    ok = how.parse( pc.filter );
+                    if( ok ) {
+                        how.revert( uncmp, input );
+                        uncmp.swap( input );
+                    }
+                }
+                auto &owner = archived[ selected[pc.n] ];
+                if( ok && owner.count("dict") ) {
+                    auto d = dictionary_of( owner["dict"] );
+                    ok = d && d->decode( uncmp, input );
+                    uncmp.swap( input );
+                }
+                stages.add( profiler::DECODE, start, uncmp.size() );
+                input = std::string();
+
+                for( size_t i = 0; i < unit.size(); ++i ) {
+                    size_t p = unit[i];
+                    std::string data;
+                    bool sliced = ok;
+                    if( ok && pieces[p].sliced ) {
+                        sliced = pieces[p].at + pieces[p].len <= uncmp.size();
+                        if( sliced ) {
+                            data.assign( uncmp, size_t( pieces[p].at ), size_t( pieces[p].len ) );
+                        }
+                    } else if( i + 1 == unit.size() ) {
+                        data.swap( uncmp );
+                    } else {
+                        data = uncmp;
+                    }
+                    if( sliced && pieces[p].has_sum ) {
+                        auto start = now();
+                        sliced = crc32c( data ) == pieces[p].sum;
+                        stages.add( profiler::CHECK, start, data.size() );
+                    }
+
+                    std::lock_guard<std::mutex> lock( slots_mutex );
+                    slots[p].data.swap( data );
+                    slots[p].ok = sliced;
+                    slots[p].done = true;
+                    slots_ready.notify_all();
+                }
+            }, cost_of( u ) );
+        };
+
+        // this thread is the writer stage: pieces are written in archive order while the pool decodes the next ones.
+        // directories created so far are remembered, so every prefix is only made once.
+        outfile ofs;
+        std::set<std::string> made;
+        bool ok = true, checked = true;
+
+        for( size_t p = 0, end = pieces.size(); p < end; ++p ) {
+            auto &file = archived[ selected[ pieces[p].n ] ];
+
+            if( pieces[p].first ) {
+                progress_pct = (++progress_idx * 100) / selected.size();
+
+                title_name = file["name"];
+
+                screen.out() << "[    ] " << title_mode.str() << ": " << file["name"] << " ...\r";
+
+                ok = true;
+                checked = true;
+
+                if( upckit && !tostdout ) {
+                    // recreate folder structure
+                    wire::string  path = file["name"];
+                    wire::strings dirs = path.tokenize("\\/");
 
-            title_name = file["name"];
+                    if( path[-1] != '\\' && path[-1] != '/' ) {
+                        dirs.pop_back();
+                    }
+
+                    path.clear();
+                    for( auto &dir : dirs ) {
+                        path += dir + "/";
+                        if( made.insert( path ).second ) {
+                            mkdir(path.c_str(), 0777);
+                        }
+                    }
 
-            std::cout << "[    ] " << title_mode << ": " << file["name"] << " ...\r";
+                    auto start = now();
+                    ok = ofs.open( file["name"], field_of( file, "len" ) );
+                    stages.add( profiler::WRITE, start );
+                }
+            }
 
             std::string uncmp;
-            bool ok = true;
+            checked = checked && ( vrfyit ? pieces[p].has_crc : pieces[p].has_sum );
+
+            if( upckit || testit || vrfyit ) {
+                while( submitted < units.size() && submitted < unit_of[p] + window ) {
+                    decode( submitted++ );
+                }
 
-            if( upckit || testit ) {
-                ok = is_ok( uncmp, file["data"] );
+                auto start = now();
+                std::unique_lock<std::mutex> lock( slots_mutex );
+                slots_ready.wait( lock, [&]{ return slots[p].done; } );
+                uncmp.swap( slots[p].data );
+                ok = ok && slots[p].ok;
+                stages.add( profiler::WAIT, start );
+                done_bytes += weight( pieces[p] );
             }
 
             if( upckit && ok ) {
-                // recreate folder structure
-                wire::string  path = file["name"];
-                wire::strings dirs = path.tokenize("\\/");
-
-                if( path[-1] != '\\' && path[-1] != '/' ) {
-                    dirs.pop_back();
+                // try to unpack it
+                auto start = now();
+                if( tostdout ) {
+                    stdout_stream.write( uncmp.data(), uncmp.size() );
+                    ok = stdout_stream.good();
+                } else {
+                    ok = ofs.write( uncmp.data(), uncmp.size() );
                 }
+                stages.add( profiler::WRITE, start, uncmp.size() );
+            }
 
-                path.clear();
-                for( auto &dir : dirs ) {
-                    path += dir + "/";
-                    mkdir(path.c_str(), 0777);
+            if( pieces[p].last ) {
+                if( upckit && ofs.is_open() ) {
+                    ok = ofs.close() && ok;
+                    if( !ok ) {
+                        std::remove( file["name"].c_str() );
+                    }
                 }
 
-                // try to unpack it
-                std::ofstream ofs( file["name"].c_str(), std::ios::binary );
-                ofs << uncmp;
-                ok = ofs.good();
+                screen.out() << ( ok ? "[ OK ] " : "[FAIL] " ) << title_mode.str() << ": " << file["name"] << ( ok && !checked && !upckit ? " (no checksum)" : "" ) << "    \n";
+                numerrors += ok ? 0 : 1;
+
+                processed++;
             }
+        }
 
-            std::cout << ( ok ? "[ OK ] " : "[FAIL] " ) << title_mode << ": " << file["name"] << "    \n";
-            numerrors += ok ? 0 : 1;
+        pool.wait();
 
-            processed++;
+        if( tostdout ) {
+            stdout_stream.flush();
         }
+
+        if( verbose && ( upckit || testit || vrfyit ) ) {
+            screen.out() << pool.report();
+            screen.out() << stages.report();
+        }
+    }
+
+    screen.close();
+
+    if( !tracefile.empty() && !stages.trace( tracefile ) ) {
+        std::cerr << "[FAIL] " << tracefile << ": cannot write to disk" << std::endl;
+        numerrors ++;
     }
 
     bool resume = ( quiet ? ( numerrors > 0 ) : true );
     if( resume ) {
         std::cout << (numerrors > 0 ? "[FAIL] " : "[ OK ] ");
-        if( moveit || packit ) {
-            std::cout << processed << " processed files, " << numerrors << " errors; " <<  total_input << " bytes -> " << total_output << " bytes (" << ratio( total_input, total_output ) << "%); " << taken() << " secs" << std::endl;
+        if( moveit || packit || updtit ) {
+            std::cout << processed << " processed files, " << numerrors << " errors; " <<  total_input << " bytes -> " << total_output << " bytes (" << ratio( total_input, total_output ) << "%); ";
+            if( duplicates ) {
+                std::cout << duplicates << " duplicates (" << deduped << " bytes deduplicated); ";
+            }
+            if( bypassed ) {
+                std::cout << bypassed << " incompressible (" << bypassed_bytes << " bytes stored without trying encoders); ";
+            }
+            std::cout << taken() << " secs" << std::endl;
         } else {
             std::cout << processed << " processed files, " << numerrors << " errors;" << std::endl;
         }